@@ -0,0 +1,182 @@
+#include "ChartCache.h"
+#include <vector>
+
+using namespace egp;
+
+namespace
+{
+	bool splitsCodePoint(std::string_view input, std::size_t position)
+	{
+		return position < input.length() && (input[position] & 0xC0) == 0x80;
+	}
+
+	std::size_t chartBytes(std::string_view input, const EarlyVec& chart)
+	{
+		// the input is counted twice, once more for the trie labels
+		std::size_t bytes = 2 * input.length() + chart.capacity() * sizeof(EarlySet);
+		for (const EarlySet& set : chart)
+			bytes += set.capacity() * sizeof(EarlyItem);
+		return bytes;
+	}
+}
+
+ChartCache::ChartCache(const Grammar& g, std::size_t memoryBudget)
+	: grammar(&g), budget(memoryBudget)
+{
+}
+
+ChartCache::ChartCache(const CompiledGrammar& g, std::size_t memoryBudget)
+	: compiled(&g), budget(memoryBudget)
+{
+}
+
+EarlyVec ChartCache::buildItems(std::string_view input)
+{
+	EntryIt entry;
+	std::size_t length;
+	if (!findPrefix(input, entry, length)) {
+		EarlyVec s = grammar ? egp::buildItems(*grammar, input) : egp::buildItems(*compiled, input);
+		remember(input, s);
+		return s;
+	}
+
+	entries.splice(entries.begin(), entries, entry);
+	if (length == input.length() && entry->input == input) {
+		reused += length;
+		return entry->chart;
+	}
+
+	// Resume at a code point boundary of both inputs, otherwise the last
+	// reused set could hold a scan of a code point that differs
+	while (length > 0 && (splitsCodePoint(input, length) || splitsCodePoint(entry->input, length)))
+		--length;
+	length = std::min(length, entry->chart.size() - 1);
+	reused += length;
+
+	EarlyVec s(entry->chart.begin(), entry->chart.begin() + length + 1);
+	s = grammar ? resumeItems(*grammar, input, std::move(s)) : resumeItems(*compiled, input, std::move(s));
+	remember(input, s);
+	return s;
+}
+
+void ChartCache::clear()
+{
+	root = Node();
+	entries.clear();
+	usage = 0;
+}
+
+bool ChartCache::findPrefix(std::string_view input, EntryIt& entry, std::size_t& length) const
+{
+	if (root.count == 0)
+		return false;
+
+	const Node* node = &root;
+	entry = root.entry;
+	length = 0;
+	while (length < input.length()) {
+		auto it = node->children.find(input[length]);
+		if (it == node->children.end())
+			break;
+
+		const Node* child = it->second.get();
+		std::size_t k = 0;
+		while (k < child->label.length() && length + k < input.length() && child->label[k] == input[length + k])
+			++k;
+
+		// every input below child shares the matched part of its label
+		entry = child->entry;
+		length += k;
+		if (k < child->label.length())
+			break;
+		node = child;
+	}
+
+	// the input itself may be remembered below a longer one
+	if (length == input.length() && node->ends && node->ending->input.length() == length)
+		entry = node->ending;
+	return true;
+}
+
+void ChartCache::insert(EntryIt entry)
+{
+	const std::string& input = entry->input;
+	Node* node = &root;
+	std::size_t length = 0;
+	node->count++;
+	node->entry = entry;
+
+	while (length < input.length()) {
+		std::unique_ptr<Node>& slot = node->children[input[length]];
+		if (!slot) {
+			slot.reset(new Node());
+			slot->label = input.substr(length);
+			length = input.length();
+		}
+		else {
+			std::size_t k = 0;
+			while (k < slot->label.length() && length + k < input.length() && slot->label[k] == input[length + k])
+				++k;
+
+			// split the edge where the inputs diverge
+			if (k < slot->label.length()) {
+				std::unique_ptr<Node> middle(new Node());
+				middle->label = slot->label.substr(0, k);
+				middle->count = slot->count;
+				middle->entry = slot->entry;
+				slot->label.erase(0, k);
+				char first = slot->label[0];
+				middle->children[first] = std::move(slot);
+				slot = std::move(middle);
+			}
+			length += k;
+		}
+
+		node = slot.get();
+		node->count++;
+		node->entry = entry;
+	}
+	node->ends = true;
+	node->ending = entry;
+}
+
+void ChartCache::erase(EntryIt entry)
+{
+	const std::string& input = entry->input;
+	std::vector<Node*> path = { &root };
+	std::size_t length = 0;
+	while (length < input.length()) {
+		Node* child = path.back()->children[input[length]].get();
+		length += child->label.length();
+		path.push_back(child);
+	}
+	path.back()->ends = false;
+
+	// bottom up, so a node can take its new entry from a remaining child
+	for (std::size_t i = path.size(); i-- > 0;) {
+		Node* node = path[i];
+		if (--node->count == 0 && i > 0) {
+			path[i - 1]->children.erase(node->label[0]);
+			continue;
+		}
+		if (node->count > 0 && node->entry == entry)
+			node->entry = node->ends ? node->ending : node->children.begin()->second->entry;
+	}
+}
+
+void ChartCache::remember(std::string_view input, const EarlyVec& chart)
+{
+	std::size_t bytes = chartBytes(input, chart);
+	if (bytes > budget)
+		return;
+
+	while (usage + bytes > budget && !entries.empty()) {
+		usage -= entries.back().bytes;
+		erase(std::prev(entries.end()));
+		entries.pop_back();
+	}
+
+	entries.push_front({ std::string(input), chart, bytes });
+	usage += bytes;
+	insert(entries.begin());
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "GrammarRecognizer.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <cstddef>
+
+namespace egp
+{
+	// Remembers the charts of recent inputs for one grammar. Earley set i
+	// only depends on the grammar and input[0..i), so a new input that
+	// shares a prefix with a remembered one resumes from the chart of that
+	// prefix (see resumeItems) instead of starting over at position 0.
+	//
+	// Inputs are indexed by a radix trie, which finds the remembered input
+	// with the longest common prefix in one walk over the new input. The
+	// charts are kept within memoryBudget bytes (approximately, counting
+	// the items, the inputs and the trie) and the least recently used ones
+	// are dropped first. The grammar must outlive the cache.
+	class ChartCache
+	{
+	public:
+		explicit ChartCache(const Grammar& g, std::size_t memoryBudget = 64 << 20);
+		explicit ChartCache(const CompiledGrammar& g, std::size_t memoryBudget = 64 << 20);
+		ChartCache(const ChartCache&) = delete;
+		ChartCache& operator=(const ChartCache&) = delete;
+
+		// Same chart as egp::buildItems(g, input)
+		EarlyVec buildItems(std::string_view input);
+
+		void clear();
+		std::size_t size() const { return entries.size(); }
+		std::size_t memoryUsage() const { return usage; }
+		std::size_t reusedBytes() const { return reused; }	// input bytes not parsed again so far
+
+	private:
+		struct Entry
+		{
+			std::string input;
+			EarlyVec chart;
+			std::size_t bytes = 0;
+		};
+		typedef std::list<Entry>::iterator EntryIt;
+
+		// Edges are labelled with strings, a node exists only where inputs
+		// diverge or end. Every node knows how many remembered inputs pass
+		// through it and one of them, which shares its whole prefix.
+		struct Node
+		{
+			std::string label;
+			std::map<char, std::unique_ptr<Node>> children;
+			int count = 0;
+			EntryIt entry;
+			bool ends = false;		// an input ends here, the one in ending
+			EntryIt ending;
+		};
+
+		bool findPrefix(std::string_view input, EntryIt& entry, std::size_t& length) const;
+		void insert(EntryIt entry);
+		void erase(EntryIt entry);
+		void remember(std::string_view input, const EarlyVec& chart);
+
+		const Grammar* grammar = nullptr;
+		const CompiledGrammar* compiled = nullptr;
+		std::size_t budget;
+		std::size_t usage = 0;
+		std::size_t reused = 0;
+		std::list<Entry> entries;	// most recently used first
+		Node root;
+	};
+}
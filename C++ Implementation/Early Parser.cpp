@@ -7,9 +7,96 @@
 #include "GrammarInterpreter.h"
 #include <algorithm>
 #include "GrammarParser.h"
+#include "StaticGrammar.h"
+#include "GrammarLoader.h"
+#include "GrammarDiagnostics.h"
+#include "GrammarCompiler.h"
+#include "Utf8.h"
+#include "ChartCache.h"
+#include "IncrementalParser.h"
+#include "PackedChart.h"
+#include "ParseTreeImage.h"
+#include "FileParser.h"
+#include "Lr0Automaton.h"
+#include "GrammarNormalizer.h"
+#include "RuleVisitor.h"
+#include "ResultCache.h"
+#include "GrammarSearch.h"
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <tuple>
 
 void testInterpreter();
 
+// Same language as g1 in main()
+const char* arithmeticGrammar =
+    "Sum -> Sum [+-] Product | Product\n"
+    "Product -> Product [*/] Factor | Factor\n"
+    "Factor -> \"(\" Sum \")\" | [0-9]+";
+
+const char* arithmeticInputs[] = { "1+(2*3+4)", "12*(3-45)/6", "1+", "(1" };
+
+egp::ParseNode* treeFromChart(const egp::Grammar& g, std::string_view input, const egp::EarlyVec& s)
+{
+    egp::EarlyVec inverted = egp::invertEarlyVec(s, g);
+    egp::sortEarlyVec(inverted);
+    return egp::buildParseTree(input, inverted, g);
+}
+
+// The tree of the plain pipeline, which the other engines are checked against
+egp::ParseNode* parseTree(const egp::Grammar& g, std::string_view input)
+{
+    return treeFromChart(g, input, egp::buildItems(g, input));
+}
+
+// The complete items of every set, sorted. Only these are inverted, and
+// engines that leave out predictions which cannot lead anywhere still
+// agree with buildItems on them.
+std::vector<std::vector<std::tuple<int, int, int>>> completeItems(const egp::EarlyVec& s, const egp::Grammar& g)
+{
+    std::vector<std::vector<std::tuple<int, int, int>>> items(s.size());
+    for (std::size_t i = 0; i < s.size(); i++) {
+        for (const egp::EarlyItem& item : s[i]) {
+            if ((std::size_t)item.next == g.rules[item.rule].definition.size())
+                items[i].push_back({ item.rule, item.next, item.start });
+        }
+        std::sort(items[i].begin(), items[i].end());
+    }
+    return items;
+}
+
+// Every item of every set, sorted, for engines that promise the chart of
+// buildItems in any order
+std::vector<std::vector<std::tuple<int, int, int>>> sortedItems(const egp::EarlyVec& s)
+{
+    std::vector<std::vector<std::tuple<int, int, int>>> items(s.size());
+    for (std::size_t i = 0; i < s.size(); i++) {
+        for (const egp::EarlyItem& item : s[i])
+            items[i].push_back({ item.rule, item.next, item.start });
+        std::sort(items[i].begin(), items[i].end());
+    }
+    return items;
+}
+
+bool sameTree(const egp::ParseNode* a, const egp::ParseNode* b)
+{
+    if (a == nullptr || b == nullptr)
+        return a == b;
+    if (a->rule != b->rule || a->label != b->label.view() || a->children.size() != b->children.size())
+        return false;
+    for (std::size_t i = 0; i < a->children.size(); i++) {
+        if (!sameTree(a->children[i], b->children[i]))
+            return false;
+    }
+    return true;
+}
+
+void printCheck(const std::string& what, bool same)
+{
+    std::cout << what << ": " << (same ? "same" : "DIFFERENT") << "\n";
+}
+
 void testMemoryLeak()
 {
     std::string input = "Sum -> Sum [Test|Terminals] Product | Product";
@@ -26,9 +113,916 @@ void testMemoryLeak()
     }
 }
 
+// Same rules as g1 in main(), declared at compile time
+struct StaticArithmetic
+{
+    enum { Sum, Product, Factor, Number };
+    static constexpr const char* names[] = { "Sum", "Product", "Factor", "Number" };
+    static constexpr int start = Sum;
+    static constexpr egp::StaticRule rules[] = {
+        { Sum, { egp::ruleRef(Sum), egp::charSet("+-"), egp::ruleRef(Product) } },
+        { Sum, { egp::ruleRef(Product) } },
+        { Product, { egp::ruleRef(Product), egp::charSet("*/"), egp::ruleRef(Factor) } },
+        { Product, { egp::ruleRef(Factor) } },
+        { Factor, { egp::charSet("("), egp::ruleRef(Sum), egp::charSet(")") } },
+        { Factor, { egp::ruleRef(Number) } },
+        { Number, { egp::charRange('0', '9') } }
+    };
+};
+
+void testStaticGrammar()
+{
+    std::string input = "1+(2*3+4)";
+    egp::Grammar g = egp::buildStaticGrammar<StaticArithmetic>();
+
+    egp::EarlyVec s = egp::buildStaticItems<StaticArithmetic>(input);
+    egp::EarlyVec inverted = egp::invertEarlyVec(s, g);
+    egp::sortEarlyVec(inverted);
+    egp::ParseNode* root = egp::buildParseTree(input, inverted, g);
+    egp::printParseTree(root, true);
+
+    egp::ParseNode* runtimeRoot = parseTree(g, input);
+    printCheck("static chart", completeItems(s, g) == completeItems(egp::buildItems(g, input), g));
+    printCheck("static tree", sameTree(root, runtimeRoot));
+    egp::deleteParseTree(runtimeRoot);
+    egp::deleteParseTree(root);
+}
+
+// Repeated operands that match empty are dropped, (a?)* is a* and ()*
+// repeats nothing, or the helper rule derives itself
+void testGrammarLoader()
+{
+    const char* grammars[] = {
+        "S -> \"x\" (\"a\"?)* \"y\"",
+        "S -> \"x\" ()* \"y\""
+    };
+    std::string inputs[] = { "xaay", "xy" };
+
+    for (const char* text : grammars) {
+        egp::Grammar g = gi::loadGrammar(text);
+        for (const std::string& input : inputs) {
+            egp::EarlyVec inverted = egp::invertEarlyVec(egp::buildItems(g, input), g);
+            egp::sortEarlyVec(inverted);
+            egp::ParseNode* root = egp::buildParseTree(input, inverted, g);
+            std::cout << text << " on \"" << input << "\":\n";
+            if (root == nullptr) {
+                std::cout << "no parse\n";
+                continue;
+            }
+            egp::printParseTree(root);
+            egp::deleteParseTree(root);
+        }
+    }
+}
+
+// Prefix "-" takes no precedence from binary "-" unless %prec gives it
+// one, so every input has a tree with either grammar
+void testPrecedence()
+{
+    const char* grammars[] = {
+        "E -> E \"+\" E | E \"-\" E | E \"*\" E | \"-\" E | \"a\" | \"b\"\n"
+        "%left \"+\" \"-\"\n"
+        "%left \"*\"",
+        "E -> E \"+\" E | E \"-\" E | E \"*\" E | \"-\" E %prec \"neg\" | \"a\" | \"b\"\n"
+        "%left \"+\" \"-\"\n"
+        "%left \"*\"\n"
+        "%right \"neg\""
+    };
+    std::string inputs[] = { "--a", "a--b", "a*-b", "a-b*a" };
+
+    for (const char* text : grammars) {
+        egp::Grammar g = gi::loadGrammar(text);
+        egp::CompiledGrammar cg = egp::compileGrammar(g);
+        egp::Lr0Automaton a = egp::buildLr0Automaton(cg);
+        for (const std::string& input : inputs) {
+            egp::EarlyVec inverted = egp::invertEarlyVec(egp::buildItems(g, input), g);
+            egp::sortEarlyVec(inverted);
+            egp::ParseNode* root = egp::buildParseTree(input, inverted, g);
+            egp::ParseNode* compiledRoot = treeFromChart(g, input, egp::buildItems(cg, input));
+            egp::ParseNode* automatonRoot = treeFromChart(g, input, egp::unpackAutomatonChart(a, egp::buildAutomatonItems(a, cg, input)));
+            std::cout << input << ":\n";
+            printCheck("compiled tree", sameTree(compiledRoot, root));
+            printCheck("automaton tree", sameTree(automatonRoot, root));
+            for (egp::ParseNode* tree : { compiledRoot, automatonRoot }) {
+                if (tree != nullptr)
+                    egp::deleteParseTree(tree);
+            }
+            if (root == nullptr) {
+                std::cout << "no parse\n";
+                continue;
+            }
+            egp::printParseTree(root);
+            egp::deleteParseTree(root);
+        }
+    }
+}
+
+// A compiled image loaded back, and the grammar decompiled from it, parse
+// like the grammar they came from
+void testCompiledGrammar()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    std::string path = (std::filesystem::temp_directory_path() / "arithmetic.egpc").string();
+    egp::writeCompiledGrammar(egp::compileGrammar(g), path);
+    egp::CompiledGrammar cg = egp::loadCompiledGrammar(path);
+    egp::Grammar decompiled = egp::decompileGrammar(cg);
+
+    for (const char* input : arithmeticInputs) {
+        egp::EarlyVec s = egp::buildItems(g, input);
+        egp::EarlyVec compiled = egp::buildItems(cg, input);
+        egp::ParseNode* root = treeFromChart(g, input, s);
+        egp::ParseNode* compiledRoot = treeFromChart(decompiled, input, compiled);
+        egp::ParseNode* decompiledRoot = parseTree(decompiled, input);
+
+        std::cout << input << ":\n";
+        printCheck("compiled chart", completeItems(compiled, g) == completeItems(s, g));
+        printCheck("compiled tree", sameTree(compiledRoot, root));
+        printCheck("decompiled tree", sameTree(decompiledRoot, root));
+        for (egp::ParseNode* tree : { root, compiledRoot, decompiledRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+// A grammar file loaded in one pass parses like the same rules read one
+// at a time with interpretRule
+void testGrammarFile()
+{
+    const char* lines[] = {
+        "Sum -> Sum [+-] Product | Product",
+        "Product -> Product [*/] Factor | Factor",
+        "Factor -> \"(\" Sum \")\" | Number",
+        "Number -> [0123456789] Number | [0123456789]"
+    };
+
+    std::string text;
+    egp::Grammar interpreted;
+    interpreted.startRule = "Sum";
+    for (std::string line : lines) {
+        text += line + "\n";
+        line.erase(remove(line.begin(), line.end(), ' '), line.end());
+
+        egp::ParseNode* root = parseTree(gi::interpreterGrammar, line);
+        egp::ParseNode* actionTree = egp::applySemanticActions(root, gi::interpreterActions);
+        for (const egp::Rule& rule : gi::interpretRule(actionTree))
+            interpreted.rules.push_back(rule);
+        egp::deleteParseTree(actionTree);
+        egp::deleteParseTree(root);
+    }
+    egp::Grammar loaded = gi::loadGrammar(text);
+
+    for (const char* input : arithmeticInputs) {
+        egp::ParseNode* root = parseTree(loaded, input);
+        egp::ParseNode* interpretedRoot = parseTree(interpreted, input);
+        printCheck(std::string(input) + " loaded tree", sameTree(root, interpretedRoot));
+        for (egp::ParseNode* tree : { root, interpretedRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// EBNF operators accept what the rules they stand for accept, and their
+// helper rules are spliced into the tree by every engine alike
+void testEbnf()
+{
+    egp::Grammar ebnf = gi::loadGrammar("S -> \"x\" (\"a\" | \"b\")* \"y\"+ \",\"?");
+    egp::Grammar bnf = gi::loadGrammar(
+        "S -> \"x\" A Y C\n"
+        "A -> A \"a\" | A \"b\" | \n"
+        "Y -> Y \"y\" | \"y\"\n"
+        "C -> \",\" | ");
+    egp::CompiledGrammar cg = egp::compileGrammar(ebnf);
+    std::string inputs[] = { "xy", "xabay", "xbyy,", "xa", "x,y", "xyy,," };
+
+    for (const std::string& input : inputs) {
+        egp::ParseNode* root = parseTree(ebnf, input);
+        egp::ParseNode* compiledRoot = treeFromChart(ebnf, input, egp::buildItems(cg, input));
+        std::cout << input << ":\n";
+        printCheck("accepted as BNF", egp::isAccepted(egp::buildItems(bnf, input), bnf, input) == (root != nullptr));
+        printCheck("compiled tree", sameTree(compiledRoot, root));
+        if (root != nullptr) {
+            egp::printParseTree(root);
+            egp::deleteParseTree(root);
+        }
+        if (compiledRoot != nullptr)
+            egp::deleteParseTree(compiledRoot);
+    }
+}
+
+// Ranges and negated classes match whole code points, in both engines
+void testCharacterClasses()
+{
+    egp::Grammar g = gi::loadGrammar("S -> [a-z_] [a-z0-9_]* \"=\" [^;]+ \";\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::pair<std::string, bool> inputs[] = {
+        { "x1=a b;", true }, { "_=\xCE\xB1\xCE\xB2;", true }, { "1x=a;", false },
+        { "x=;", false }, { "x=a;b;", false }, { "X=a;", false }
+    };
+
+    for (const auto& [input, accepted] : inputs) {
+        egp::ParseNode* root = parseTree(g, input);
+        egp::ParseNode* compiledRoot = treeFromChart(g, input, egp::buildItems(cg, input));
+        std::cout << input << ":\n";
+        printCheck("accepted as expected", (root != nullptr) == accepted);
+        printCheck("compiled tree", sameTree(compiledRoot, root));
+        for (egp::ParseNode* tree : { root, compiledRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// matchRun agrees with decoding one code point at a time, and the runs
+// the compiled engine scans build the trees of the plain one
+void testUtf8()
+{
+    const CharRange letters[] = { { 'a', 'z' }, { 0x3B1, 0x3C9 } };
+    std::string texts[] = {
+        std::string(40, 'a') + " b", std::string(20, 'x') + "\xCE\xB1\xCE\xB2" + std::string(20, 'y'),
+        "\xCE\xB1\xCE", "ab\xFF" "cd", ""
+    };
+    for (const std::string& text : texts) {
+        std::size_t expected = 0;
+        while (expected < text.length()) {
+            char32_t c;
+            std::size_t length = egp::decodeUtf8(text.data() + expected, text.length() - expected, c);
+            bool inside = false;
+            for (const CharRange& range : letters)
+                inside = inside || (c >= range.first && c <= range.last);
+            if (!inside)
+                break;
+            expected += length;
+        }
+        printCheck("run of " + std::to_string(text.length()) + " bytes",
+                   egp::matchRun(text.data(), text.length(), letters, 2) == expected);
+    }
+
+    egp::Grammar g = gi::loadGrammar("S -> Word (\" \" Word)*\nWord -> [a-z\xCE\xB1-\xCF\x89]+ | [0-9]+ \"\xC3\xA9\"?");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string inputs[] = { "hello \xCE\xB1\xCE\xB2\xCE\xB3 42\xC3\xA9 7", std::string(100, 'q') + " " + std::string(30, 'z'), "hello  x" };
+    for (const std::string& input : inputs) {
+        egp::ParseNode* root = parseTree(g, input);
+        egp::ParseNode* compiledRoot = treeFromChart(g, input, egp::buildItems(cg, input));
+        printCheck("compiled tree of " + std::to_string(input.length()) + " bytes", sameTree(compiledRoot, root));
+        for (egp::ParseNode* tree : { root, compiledRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// A recovered tree is the tree of the repaired input
+void testDiagnostics()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    std::string inputs[] = { "1+*2", "(1+2", "1+2)", "12+34*", "", "1+(2*3)" };
+
+    for (const std::string& input : inputs) {
+        egp::EarlyVec s = egp::buildItems(g, input);
+        std::cout << "\"" << input << "\": ";
+        if (egp::isAccepted(s, g, input))
+            std::cout << "accepted\n";
+        else
+            std::cout << egp::formatParseFailure(egp::describeFailure(s, g, input)) << "\n";
+
+        egp::RecoveredParse recovered = egp::recoverParse(g, input);
+        egp::ParseNode* root = parseTree(g, recovered.input);
+        std::cout << "recovered as \"" << recovered.input << "\" with " << recovered.repairs.size() << " repairs\n";
+        printCheck("recovered tree", recovered.tree != nullptr && sameTree(recovered.tree, root));
+        for (egp::ParseNode* tree : { recovered.tree, root }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// Inputs that share a prefix with a remembered one resume from its chart,
+// which must give the chart of a parse from scratch
+void testChartCache()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    egp::ChartCache cache(g), compiledCache(cg);
+    std::string inputs[] = { "1+(2*3+4)", "1+(2*3+5)", "1+(2*", "1+(2*3+4)*7", "1+", "9", "1+(2*3+4)" };
+
+    for (const std::string& input : inputs) {
+        egp::EarlyVec s = cache.buildItems(input);
+        printCheck(input + " cached chart", sortedItems(s) == sortedItems(egp::buildItems(g, input)));
+        printCheck(input + " compiled cached chart", sortedItems(compiledCache.buildItems(input)) == sortedItems(egp::buildItems(cg, input)));
+
+        egp::ParseNode* root = treeFromChart(g, input, s);
+        egp::ParseNode* plainRoot = parseTree(g, input);
+        printCheck(input + " cached tree", sameTree(root, plainRoot));
+        for (egp::ParseNode* tree : { root, plainRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+    std::cout << cache.size() << " charts, " << cache.reusedBytes() << " bytes reused\n";
+}
+
+// After every edit the parser's chart and tree are those of the new text
+// parsed from scratch, valid or not
+void testIncrementalParser()
+{
+    egp::Grammar g = gi::loadGrammar(
+        "Doc -> Item*\n"
+        "Item -> Name \"=\" Value \";\"\n"
+        "Name -> [a-z]+\n"
+        "Value -> [0-9]+ | \"{\" Item* \"}\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string text = "a=1;b={c=2;d={e=3;};f=4;};g=5;";
+    struct { std::size_t offset, removed; const char* inserted; } edits[] = {
+        { 2, 1, "42" }, { 10, 1, "77" }, { 0, 0, "x=9;" }, { 4, 0, "=" }, { 4, 1, "" }, { 4, 5, "" }
+    };
+
+    egp::IncrementalParser parser(g, text), compiledParser(g, text, &cg);
+    for (const auto& edit : edits) {
+        parser.applyEdit(edit.offset, edit.removed, edit.inserted);
+        compiledParser.applyEdit(edit.offset, edit.removed, edit.inserted);
+        const std::string& edited = parser.getText();
+
+        egp::ParseNode* root = parseTree(g, edited);
+        std::cout << edited << ": ";
+        if (root == nullptr)
+            std::cout << "no parse, ";
+        std::cout << parser.getRebuiltSets() << " sets rebuilt, " << parser.getReusedNodes() << " nodes reused\n";
+        printCheck("incremental chart", sortedItems(parser.getChart()) == sortedItems(egp::buildItems(g, edited)));
+        printCheck("incremental tree", sameTree(parser.getTree(), root));
+        printCheck("compiled incremental chart", sortedItems(compiledParser.getChart()) == sortedItems(egp::buildItems(cg, edited)));
+        printCheck("compiled incremental tree", sameTree(compiledParser.getTree(), root));
+        if (root != nullptr)
+            egp::deleteParseTree(root);
+    }
+}
+
+// A packed chart holds the sets of the compiled engine in less memory
+void testPackedChart()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+
+    for (const char* input : arithmeticInputs) {
+        egp::PackedChart packed = egp::buildPackedItems(cg, input);
+        egp::EarlyVec s = egp::unpackChart(packed);
+        egp::EarlyVec compiled = egp::buildItems(cg, input);
+        egp::ParseNode* root = treeFromChart(g, input, s);
+        egp::ParseNode* plainRoot = parseTree(g, input);
+
+        std::cout << input << ": " << packed.memoryUsage() << " bytes packed, " << egp::chartMemoryUsage(compiled) << " unpacked\n";
+        printCheck("packed chart", sortedItems(s) == sortedItems(compiled));
+        printCheck("packed tree", sameTree(root, plainRoot));
+        for (egp::ParseNode* tree : { root, plainRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// Recognizing without the chart gives the verdict of the full chart, in
+// memory that follows the nesting of the input
+void testRecognizer()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string flat = "1", nested = "1";
+    for (int i = 0; i < 2000; i++) {
+        flat += "+2*3";
+        nested = "(" + nested + ")";
+    }
+    std::vector<std::string> inputs(std::begin(arithmeticInputs), std::end(arithmeticInputs));
+    inputs.insert(inputs.end(), { flat, nested, flat + "+" });
+
+    for (const std::string& input : inputs) {
+        egp::RecognitionStats stats;
+        bool accepted = egp::recognize(cg, input, &stats);
+        egp::EarlyVec s = egp::buildItems(cg, input);
+        std::cout << input.length() << " bytes: peak " << stats.peakMemory << " of " << egp::chartMemoryUsage(s)
+                  << " bytes, " << stats.peakSets << " sets\n";
+        printCheck("recognized", accepted == egp::isAccepted(s, g, input));
+    }
+}
+
+bool sameImage(const egp::ParseTreeImage& image, const egp::ParseTreeRecord* record, const egp::ParseNode* node,
+               std::string_view input, std::size_t start)
+{
+    if (record->rule != node->rule || egp::nodeLabel(image, record, input) != node->label.view() ||
+        record->start != start || record->length != node->length || record->childCount != node->children.size())
+        return false;
+    const egp::ParseTreeRecord* child = egp::firstChild(record);
+    for (const egp::ParseNode* childNode : node->children) {
+        if (!sameImage(image, child, childNode, input, start + childNode->offset))
+            return false;
+        child = egp::nextSibling(child);
+    }
+    return true;
+}
+
+// An image written to disk and mapped back holds every node of the tree
+void testParseTreeImage()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    std::string path = (std::filesystem::temp_directory_path() / "tree.egpt").string();
+
+    for (const char* input : { "1+(2*3+4)", "12*(3-45)/6" }) {
+        egp::ParseNode* root = parseTree(g, input);
+        egp::writeParseTree(egp::encodeParseTree(root, input), path);
+        egp::ParseTreeImage image = egp::loadParseTree(path);
+        std::cout << input << ": " << image.header->nodeCount << " nodes in " << image.header->imageSize << " bytes\n";
+        printCheck("tree image", sameImage(image, image.root(), root, input, root->offset));
+        egp::deleteParseTree(root);
+    }
+    std::filesystem::remove(path);
+}
+
+// Tokens refer to the input until ownTokenLabels copies their text
+void testTokenLabels()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    std::string input = "1+(2*3+4)";
+    egp::ParseNode* root = parseTree(g, input);
+
+    bool intoInput = true;
+    std::vector<const egp::ParseNode*> pending = { root };
+    while (!pending.empty()) {
+        const egp::ParseNode* node = pending.back();
+        pending.pop_back();
+        if (node->rule == -1) {
+            const char* text = node->label.view().data();
+            intoInput = intoInput && node->label.refersToInput() && text >= input.data() && text < input.data() + input.length();
+        }
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+    }
+    printCheck("tokens in the input", intoInput);
+
+    egp::ownTokenLabels(root);
+    std::string copy = input;
+    std::fill(input.begin(), input.end(), '?');
+    egp::ParseNode* copyRoot = parseTree(g, copy);
+    printCheck("owned tree", sameTree(root, copyRoot));
+    egp::deleteParseTree(copyRoot);
+    egp::deleteParseTree(root);
+}
+
+// Every record handed over by parseFile is the tree of its text parsed
+// with the record rule as the start rule
+void testFileParser()
+{
+    egp::Grammar g = gi::loadGrammar(
+        "Log -> Record+\n"
+        "Record -> [a-z]+ \"=\" Value \";\"\n"
+        "Value -> [0-9]+ | \"(\" Value (\",\" Value)* \")\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    egp::Grammar recordGrammar = g;
+    recordGrammar.startRule = "Record";
+
+    std::string text;
+    for (int i = 0; i < 100; i++)
+        text += "k" + std::string(i % 7 + 1, 'a') + "=" + (i % 3 ? std::to_string(i * 37) : "(1,(2,3)," + std::to_string(i) + ")") + ";";
+    std::string path = (std::filesystem::temp_directory_path() / "records.log").string();
+    std::ofstream(path, std::ios::binary) << text;
+
+    int records = 0, same = 0;
+    egp::FileParseStats stats;
+    bool parsed = egp::parseFile(path, g, cg, [&](egp::ParseNode* record, std::size_t offset) {
+        egp::ParseNode* root = parseTree(recordGrammar, std::string_view(text).substr(offset, record->length));
+        records++;
+        same += sameTree(record, root);
+        egp::deleteParseTree(root);
+        egp::deleteParseTree(record);
+    }, &stats);
+
+    std::cout << records << " records, " << stats.chartBytes << " chart bytes spilled\n";
+    printCheck("record trees", parsed && records == 100 && same == records);
+    std::filesystem::remove(path);
+}
+
+// parseRecords restarts the chart after every record, each record tree is
+// the tree of its text parsed on its own
+void testRecordParser()
+{
+    egp::Grammar g = gi::loadGrammar(
+        "Record -> [a-z]+ \"=\" Value \";\"\n"
+        "Value -> [0-9]+ | \"(\" Value (\",\" Value)* \")\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string input = "a=1;bb=(1,2);ccc=((3),4,55);d=6;";
+
+    for (const std::string& text : { input, input + "e=" }) {
+        int records = 0, same = 0;
+        egp::RecordParseStats stats;
+        bool parsed = egp::parseRecords(text, g, cg, [&](egp::ParseNode* record, std::size_t offset) {
+            egp::ParseNode* root = parseTree(g, std::string_view(text).substr(offset, record->length));
+            records++;
+            same += sameTree(record, root);
+            egp::deleteParseTree(root);
+            egp::deleteParseTree(record);
+        }, &stats);
+
+        std::cout << text << ": " << (parsed ? "" : "stopped after ") << records << " records, "
+                  << stats.peakChartBytes << " bytes of chart at most\n";
+        printCheck("record trees", parsed == (text == input) && records == 4 && same == records);
+    }
+}
+
+// Predictions that cannot start with the next byte are left out, which
+// keeps every complete item and so every tree
+void testLookahead()
+{
+    egp::Grammar g = gi::loadGrammar(
+        "Block -> Stmt*\n"
+        "Stmt -> \"if\" Cond Stmt | \"while\" Cond Stmt | \"{\" Block \"}\" | [a-z]+ \"=\" [0-9]+ \";\"\n"
+        "Cond -> \"(\" [a-z]+ \")\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string inputs[] = { "if(a)x=1;", "while(b){y=2;if(c)z=3;}w=4;", "if(a)", "{x=1;" };
+
+    for (const std::string& input : inputs) {
+        egp::EarlyVec s = egp::buildItems(g, input);
+        egp::EarlyVec filtered = egp::buildItems(cg, input);
+        auto all = sortedItems(s), kept = sortedItems(filtered);
+        std::size_t items = 0, filteredItems = 0;
+        bool subset = true;
+        for (std::size_t i = 0; i < s.size(); i++) {
+            items += s[i].size();
+            filteredItems += filtered[i].size();
+            subset = subset && std::includes(all[i].begin(), all[i].end(), kept[i].begin(), kept[i].end());
+        }
+
+        egp::ParseNode* root = treeFromChart(g, input, s);
+        egp::ParseNode* filteredRoot = treeFromChart(g, input, filtered);
+        std::cout << input << ": " << filteredItems << " of " << items << " items\n";
+        printCheck("items kept", subset);
+        printCheck("complete items", completeItems(filtered, g) == completeItems(s, g));
+        printCheck("filtered tree", sameTree(filteredRoot, root));
+        for (egp::ParseNode* tree : { root, filteredRoot }) {
+            if (tree != nullptr)
+                egp::deleteParseTree(tree);
+        }
+    }
+}
+
+// The automaton's states unpack to the complete items of buildItems, so
+// the trees agree. With operator precedence the states also keep the
+// predictions it rules out and the items those complete, which the tree
+// builder never attaches, so then only the trees are compared.
+void testLr0Automaton()
+{
+    const char* grammars[] = {
+        arithmeticGrammar,
+        "E -> E \"+\" E | E \"*\" E | \"-\" E | \"(\" E \")\" | [a-z]\n"
+        "%left \"+\"\n"
+        "%left \"*\"",
+        "S -> \"x\" (\"a\" | \"b\")* \"y\"+ \",\"?"
+    };
+    std::string inputs[] = { "1+(2*3+4)", "12*(3-45)/6", "a+b*-c+(d*e)", "-a*b+c", "xabyy,", "xby" };
+
+    for (const char* text : grammars) {
+        egp::Grammar g = gi::loadGrammar(text);
+        egp::CompiledGrammar cg = egp::compileGrammar(g);
+        egp::Lr0Automaton a = egp::buildLr0Automaton(cg);
+        bool precedence = std::any_of(g.rules.begin(), g.rules.end(), [](const egp::Rule& rule) { return rule.precedence != 0; });
+        std::cout << a.states.size() << " states\n";
+
+        for (const std::string& input : inputs) {
+            egp::EarlyVec plain = egp::buildItems(g, input);
+            egp::EarlyVec s = egp::unpackAutomatonChart(a, egp::buildAutomatonItems(a, cg, input));
+            egp::ParseNode* root = treeFromChart(g, input, s);
+            egp::ParseNode* plainRoot = treeFromChart(g, input, plain);
+            std::cout << input << ":\n";
+            if (!precedence)
+                printCheck("automaton complete items", completeItems(s, g) == completeItems(plain, g));
+            printCheck("automaton tree", sameTree(root, plainRoot));
+            for (egp::ParseNode* tree : { root, plainRoot }) {
+                if (tree != nullptr)
+                    egp::deleteParseTree(tree);
+            }
+        }
+    }
+}
+
+// A tree of the normalized grammar restores to the tree of the original
+void testNormalizer()
+{
+    std::pair<const char*, std::vector<std::string>> cases[] = {
+        { arithmeticGrammar, { "1+(2*3+4)", "12*(3-45)/6", "7" } },
+        { "S -> A \"x\" B\nA -> \"a\" | \nB -> \"b\" B | ", { "x", "axbb", "xb" } },
+        { "S -> \"x\" (\"a\" | \"b\")* \"y\"+ \",\"?", { "xabyy,", "xy" } },
+        { "S -> (\"a\" S)?", { "", "aaa" } }
+    };
+
+    for (const auto& [text, inputs] : cases) {
+        egp::Grammar g = gi::loadGrammar(text);
+        egp::NormalizedGrammar ng = egp::normalizeGrammar(g);
+        std::cout << g.rules.size() << " rules normalized to " << ng.grammar.rules.size() << "\n";
+
+        for (const std::string& input : inputs) {
+            egp::ParseNode* normalized = parseTree(ng.grammar, input);
+            egp::ParseNode* root = parseTree(g, input);
+            egp::ParseNode* restored = normalized ? egp::restoreParseTree(normalized, ng) : nullptr;
+            printCheck("\"" + input + "\" restored tree", root != nullptr && sameTree(restored, root));
+            for (egp::ParseNode* tree : { restored, root }) {
+                if (tree != nullptr)
+                    egp::deleteParseTree(tree);
+            }
+        }
+    }
+}
+
+// Every engine that takes ParseLimits stops with the ParseError of the
+// limit it went over, and without limits builds the usual chart
+void testParseLimits()
+{
+    egp::Grammar g = gi::loadGrammar("S -> S S | \"a\"");
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    egp::Lr0Automaton a = egp::buildLr0Automaton(cg);
+    std::string input(300, 'a');
+
+    std::atomic<bool> cancel(true);
+    egp::ParseLimits items, bytes, past, cancelled;
+    items.maxItems = 10000;
+    bytes.maxChartBytes = 100000;
+    past.deadline = std::chrono::steady_clock::now();
+    cancelled.cancelled = &cancel;
+
+    std::pair<const char*, const egp::ParseLimits*> limits[] = {
+        { "items", &items }, { "chart bytes", &bytes }, { "deadline", &past }, { "cancelled", &cancelled }
+    };
+    egp::ParseErrorKind kinds[] = { egp::PARSE_ITEM_LIMIT, egp::PARSE_CHART_LIMIT, egp::PARSE_DEADLINE, egp::PARSE_CANCELLED };
+    std::pair<const char*, std::function<void(const egp::ParseLimits&)>> engines[] = {
+        { "grammar", [&](const egp::ParseLimits& l) { egp::buildItems(g, input, l); } },
+        { "compiled", [&](const egp::ParseLimits& l) { egp::buildItems(cg, input, l); } },
+        { "packed", [&](const egp::ParseLimits& l) { egp::buildPackedItems(cg, input, l); } },
+        { "automaton", [&](const egp::ParseLimits& l) { egp::buildAutomatonItems(a, cg, input, l); } },
+        { "recovery", [&](const egp::ParseLimits& l) { egp::recoverParse(g, input, l); } }
+    };
+
+    for (const auto& [engine, parse] : engines) {
+        for (std::size_t k = 0; k < std::size(limits); k++) {
+            bool stopped = false;
+            try {
+                parse(*limits[k].second);
+            }
+            catch (const egp::ParseError& e) {
+                stopped = e.kind == kinds[k];
+            }
+            printCheck(std::string(engine) + " error over " + limits[k].first, stopped);
+        }
+    }
+
+    // the tree builder only checks the deadline and cancellation
+    std::string small(40, 'a');
+    egp::EarlyVec inverted = egp::invertEarlyVec(egp::buildItems(g, small), g);
+    egp::sortEarlyVec(inverted);
+    for (int k = 2; k < 4; k++) {
+        bool stopped = false;
+        try {
+            egp::deleteParseTree(egp::buildParseTree(small, inverted, g, *limits[k].second));
+        }
+        catch (const egp::ParseError& e) {
+            stopped = e.kind == kinds[k];
+        }
+        printCheck(std::string("tree error over ") + limits[k].first, stopped);
+    }
+
+    egp::ParseNode* root = egp::buildParseTree(small, inverted, g, egp::ParseLimits());
+    egp::ParseNode* plainRoot = parseTree(g, small);
+    printCheck("unlimited chart", sortedItems(egp::buildItems(g, small, egp::ParseLimits())) == sortedItems(egp::buildItems(g, small)));
+    printCheck("unlimited tree", sameTree(root, plainRoot));
+    egp::deleteParseTree(root);
+    egp::deleteParseTree(plainRoot);
+}
+
+// Drops the nodes of unit rules and parentheses from an arithmetic tree
+egp::ParseNode* collapseUnit(const egp::ParseNode& node)
+{
+    if (node.children.size() != 1 || node.children[0]->rule == -1)
+        return new egp::ParseNode(node);
+    return node.children[0];
+}
+
+egp::ParseNode* dropParentheses(const egp::ParseNode& node)
+{
+    if (node.children.size() != 3)
+        return collapseUnit(node);
+    delete node.children[0];
+    delete node.children[2];
+    return node.children[1];
+}
+
+struct ArithmeticVisitor : public egp::RuleVisitor<ArithmeticVisitor>
+{
+    static constexpr auto actions()
+    {
+        return std::array{ egp::on("Sum", &ArithmeticVisitor::sum), egp::on("Product", &ArithmeticVisitor::product),
+                           egp::on("Factor", &ArithmeticVisitor::factor) };
+    }
+
+    egp::ParseNode* sum(const egp::ParseNode& node) { return collapseUnit(node); }
+    egp::ParseNode* product(const egp::ParseNode& node) { return collapseUnit(node); }
+    egp::ParseNode* factor(const egp::ParseNode& node) { return dropParentheses(node); }
+};
+
+// Actions bound with a RuleVisitor and with bindActions make the same tree
+void testRuleVisitor()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::ActionVec actions = egp::bindActions(g, { { "Sum", collapseUnit }, { "Product", collapseUnit }, { "Factor", dropParentheses } });
+    ArithmeticVisitor visitor;
+    visitor.bind(g);
+
+    for (const char* input : { "1+(2*3+4)", "12*(3-45)/6", "((7))" }) {
+        egp::ParseNode* root = parseTree(g, input);
+        egp::ParseNode* visited = visitor.apply(root);
+        egp::ParseNode* applied = egp::applySemanticActions(root, actions);
+        egp::printParseTree(visited, true);
+        printCheck(std::string(input) + " visited tree", sameTree(visited, applied));
+        egp::deleteParseTree(applied);
+        egp::deleteParseTree(visited);
+        egp::deleteParseTree(root);
+    }
+}
+
+// Charts and trees built in a caller's memory resource are the ones built
+// in the default resource, and are released with it
+void testMemoryResource()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+
+    for (const char* input : { "1+(2*3+4)", "12*(3-45)/6" }) {
+        std::pmr::monotonic_buffer_resource arena;
+        egp::EarlyVec s = egp::buildItems(g, input, egp::ParseLimits(), &arena);
+        egp::EarlyVec compiled = egp::buildItems(cg, input, egp::ParseLimits(), &arena);
+        egp::EarlyVec inverted = egp::invertEarlyVec(s, g);
+        egp::sortEarlyVec(inverted);
+        egp::ParseNode* root = egp::buildParseTree(input, inverted, g, egp::ReuseFunc(), egp::ParseLimits(), &arena);
+        egp::ParseNode* plainRoot = parseTree(g, input);
+
+        std::cout << input << ":\n";
+        printCheck("allocated from the arena", s.get_allocator().resource() == &arena && inverted[0].get_allocator().resource() == &arena &&
+                                         root->children.get_allocator().resource() == &arena);
+        printCheck("arena chart", sortedItems(s) == sortedItems(egp::buildItems(g, input)));
+        printCheck("arena compiled chart", sortedItems(compiled) == sortedItems(egp::buildItems(cg, input)));
+        printCheck("arena packed chart", sortedItems(egp::unpackChart(egp::buildPackedItems(cg, input, egp::ParseLimits(), &arena))) ==
+                                         sortedItems(compiled));
+        printCheck("arena tree", sameTree(root, plainRoot));
+        egp::deleteParseTree(plainRoot);
+    }
+}
+
+// A traced parse reports every phase, and every set when slowSet is 0,
+// without changing the tree
+void testTracing()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    std::string input = "1+(2*3+4)";
+    egp::RingBufferSink ring(64);
+    egp::Tracer tracer;
+    tracer.sink = &ring;
+    tracer.request = 7;
+    tracer.grammar = "arithmetic";
+    tracer.slowSet = std::chrono::nanoseconds(0);
+
+    egp::ParseNode* root;
+    {
+        egp::TraceScope scope(tracer);
+        root = parseTree(g, input);
+    }
+    egp::ParseNode* plainRoot = parseTree(g, input);
+
+    std::vector<egp::TraceEvent> events = ring.snapshot();
+    std::vector<std::string> phases;
+    std::size_t sets = 0;
+    bool request = true;
+    for (const egp::TraceEvent& event : events) {
+        request = request && event.request == 7 && std::string(event.grammar) == "arithmetic";
+        if (std::string(event.name) == "set")
+            sets++;
+        else
+            phases.push_back(event.name);
+    }
+    std::ostringstream chrome;
+    egp::writeChromeTrace(chrome, events);
+    std::cout << events.size() << " events, " << chrome.str().length() << " bytes of Chrome trace\n";
+
+    printCheck("phases", phases == std::vector<std::string>({ "recognize", "invert", "sort", "build tree" }));
+    printCheck("set events", sets == input.length() + 1);
+    printCheck("request and grammar", request);
+    printCheck("traced tree", sameTree(root, plainRoot));
+    egp::deleteParseTree(root);
+    egp::deleteParseTree(plainRoot);
+}
+
+// Results are remembered per grammar and input: a copy of a grammar has
+// an identity of its own, and the inputs kept stay within maxBytes
+void testResultCache()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::Grammar copy = g;
+    egp::ResultCache<egp::ParseTreeImage> cache(16, 1024);
+    int parses = 0;
+    auto parse = [&parses, &g](std::string_view input) {
+        parses++;
+        egp::ParseNode* root = parseTree(g, input);
+        auto image = std::make_shared<egp::ParseTreeImage>(egp::encodeParseTree(root, input));
+        egp::deleteParseTree(root);
+        return image;
+    };
+
+    std::string input = "1+(2*3+4)";
+    auto first = cache.get(g, input, parse);
+    auto second = cache.get(g, input, parse);
+    auto copied = cache.get(copy, input, parse);
+    printCheck("remembered result", first == second && first != copied && parses == 2);
+
+    egp::ParseNode* root = parseTree(g, input);
+    printCheck("cached image", sameImage(*first, first->root(), root, input, 0));
+    egp::deleteParseTree(root);
+
+    std::string large(2000, '1');
+    cache.get(g, large, parse);
+    cache.get(g, large, parse);
+    for (int i = 0; i < 20; i++)
+        cache.get(g, std::to_string(i) + "+" + std::string(100, '2'), parse);
+    std::cout << cache.size() << " results in " << cache.bytes() << " bytes, " << cache.hits() << " hits, " << cache.misses() << " misses\n";
+    printCheck("bounded", cache.size() <= 16 && cache.bytes() <= 1024 && parses == 24);
+}
+
+// The matches of one search chart are the substrings the grammar accepts
+// on their own, and their trees are the trees of those substrings
+void testGrammarSearch()
+{
+    egp::Grammar g = gi::loadGrammar(arithmeticGrammar);
+    egp::CompiledGrammar cg = egp::compileGrammar(g);
+    std::string text = "x=1+2; y=(3*45)-; z=(6";
+
+    std::vector<std::pair<std::size_t, std::size_t>> expected;
+    for (std::size_t start = 0; start < text.length(); start++) {
+        for (std::size_t end = start + 1; end <= text.length(); end++) {
+            std::string_view span = std::string_view(text).substr(start, end - start);
+            if (egp::isAccepted(egp::buildItems(g, span), g, span))
+                expected.push_back({ start, end });
+        }
+    }
+
+    egp::EarlyVec s = egp::buildSearchItems(g, text);
+    std::vector<egp::SearchMatch> matches = egp::findMatches(s, g);
+    std::vector<egp::SearchMatch> compiledMatches = egp::findMatches(egp::buildSearchItems(cg, text), cg);
+    std::vector<std::pair<std::size_t, std::size_t>> spans, compiledSpans;
+    for (const egp::SearchMatch& match : matches)
+        spans.push_back({ match.start, match.end });
+    for (const egp::SearchMatch& match : compiledMatches)
+        compiledSpans.push_back({ match.start, match.end });
+    printCheck(std::to_string(matches.size()) + " matches", spans == expected);
+    printCheck("compiled matches", compiledSpans == expected);
+
+    egp::EarlyVec inverted = egp::invertEarlyVec(s, g);
+    egp::sortEarlyVec(inverted);
+    int same = 0;
+    for (const egp::SearchMatch& match : matches) {
+        egp::ParseNode* tree = egp::buildMatchTree(text, inverted, g, match);
+        egp::ParseNode* root = parseTree(g, std::string_view(text).substr(match.start, match.end - match.start));
+        same += sameTree(tree, root);
+        egp::deleteParseTree(tree);
+        egp::deleteParseTree(root);
+    }
+    printCheck("match trees", same == (int)matches.size());
+
+    for (const egp::SearchMatch& match : egp::findMatches(s, g, egp::MATCH_LEFTMOST_LONGEST))
+        std::cout << text.substr(match.start, match.end - match.start) << "\n";
+}
+
 int main()
 {
     //testMemoryLeak();
+    //testStaticGrammar();
+    //testGrammarLoader();
+    //testPrecedence();
+    //testCompiledGrammar();
+    //testGrammarFile();
+    //testEbnf();
+    //testCharacterClasses();
+    //testUtf8();
+    //testDiagnostics();
+    //testChartCache();
+    //testIncrementalParser();
+    //testPackedChart();
+    //testRecognizer();
+    //testParseTreeImage();
+    //testTokenLabels();
+    //testFileParser();
+    //testRecordParser();
+    //testLookahead();
+    //testLr0Automaton();
+    //testNormalizer();
+    //testParseLimits();
+    //testRuleVisitor();
+    //testMemoryResource();
+    //testTracing();
+    //testResultCache();
+    //testGrammarSearch();
    // testInterpreter();
     egp::Grammar g1 = {
         "Sum",
@@ -144,7 +1138,7 @@ int main()
 
     std::function<egp::ParseNode* (const egp::ParseNode* const)> recursiveReducer;
     recursiveReducer = [](const egp::ParseNode* const node) -> egp::ParseNode* {
-        std::string temp = node->children[0]->label + node->children[1]->label;
+        std::string temp = node->children[0]->label.str() + node->children[1]->label.str();
         return new egp::ParseNode(-1, temp);
     };
 
@@ -153,7 +1147,7 @@ int main()
         //std::vector<egp::ParseNode*> returnVec = { nodes[0] };
         //returnVec.insert(returnVec.end(), nodes[1]->children.begin(), nodes[1]->children.end());
         //return returnVec;
-        std::vector<egp::ParseNode*> children = { node->children[0] };
+        std::pmr::vector<egp::ParseNode*> children = { node->children[0] };
         children.insert(children.end(), 
                         node->children[1]->children.begin(), 
                         node->children[1]->children.end());
@@ -165,7 +1159,7 @@ int main()
         //std::vector<egp::ParseNode*> returnVec = { nodes[0] };
         //returnVec.insert(returnVec.end(), nodes[1]->children.begin(), nodes[1]->children.end());
         //return returnVec;
-        std::vector<egp::ParseNode*> children = { node->children[0] };
+        std::pmr::vector<egp::ParseNode*> children = { node->children[0] };
         children.insert(children.end(),
             node->children[2]->children.begin(),
             node->children[2]->children.end());
@@ -261,55 +1255,61 @@ int main()
 // Memory Leak Galore. Exploratory Programming so I don't care.
 void testInterpreter()
 {
-    std::cout << "Enter starting rule name: ";
-
-    std::string startingRule;
-    std::cin >> startingRule;
-    std::cin.get();
-    std::cout << std::endl;
-
+    std::string input;
     egp::Grammar grammar;
-    grammar.startRule = startingRule;
 
-    std::cout << "Enter Rules (enter \"X\" to finish)\n";
-    
-    int ruleCount = 1;
-    std::string input;
+    // A rule that does not load is entered again, the session goes on
+    for (;;) {
+        std::cout << "Enter Rules (enter \"X\" to finish)\n";
 
-    do {
-        std::cout << ruleCount << ": ";
-        std::getline(std::cin, input);
-        input.erase(remove(input.begin(), input.end(), ' '), input.end());
+        int ruleCount = 1;
+        std::string rules;
 
-        if (input == "X" || input == "x")
-            continue;
+        do {
+            std::cout << ruleCount << ": ";
+            if (!std::getline(std::cin, input))
+                return;
 
-        egp::EarlyVec s = egp::buildItems(gi::interpreterGrammar, input);
-        egp::EarlyVec inverted = egp::invertEarlyVec(s, gi::interpreterGrammar);
-        egp::sortEarlyVec(inverted);
-        egp::ParseNode* root = egp::buildParseTree(input, inverted, gi::interpreterGrammar);
+            if (input == "X" || input == "x")
+                continue;
 
-        if (root == nullptr) {
-            std::cout << "Error: invalid rule!" << std::endl << std::endl;
-            continue;
-        }
+            rules += input + "\n";
+            ruleCount++;
+        } while (input != "X" && input != "x");
 
-        egp::ParseNode* actionTree = egp::applySemanticActions(root, gi::interpreterActions);
         try {
-            std::vector<egp::Rule> newRules = gi::interpretRule(actionTree);
-            grammar.rules.insert(grammar.rules.end(), newRules.begin(), newRules.end());
-            ruleCount++;
+            grammar = gi::loadGrammar(rules);
+            break;
         }
-        catch (std::string e) {
-            std::cout << "Error: " << e << std::endl << std::endl;
+        catch (const gi::GrammarError& e) {
+            std::cout << "Error: " << e.what() << std::endl << std::endl;
         }
+    }
 
-    } while (input != "X" && input != "x");
+    // The start rule must be one of the rules entered
+    for (;;) {
+        std::cout << "Enter starting rule name: ";
+
+        std::string startingRule;
+        if (!std::getline(std::cin, startingRule))
+            return;
+        std::cout << std::endl;
+
+        bool defined = std::any_of(grammar.rules.begin(), grammar.rules.end(), [&startingRule](const egp::Rule& rule) {
+            return rule.name == startingRule;
+        });
+        if (defined) {
+            grammar.startRule = startingRule;
+            break;
+        }
+        std::cout << "Error: no rule is named \"" << startingRule << "\"" << std::endl << std::endl;
+    }
 
     do {
         std::cout << "\n=================================\n\n";
         std::cout << "Enter Test Input: ";
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input))
+            return;
         std::cout << std::endl;
 
         if (input == "X" || input == "x")
@@ -321,7 +1321,14 @@ void testInterpreter()
         egp::ParseNode* root = egp::buildParseTree(input, inverted, grammar);
 
         if (root == nullptr) {
-            std::cout << "Error: invalid input!" << std::endl << std::endl;
+            std::cout << "Error: " << egp::formatParseFailure(egp::describeFailure(s, grammar, input)) << std::endl;
+
+            egp::RecoveredParse recovered = egp::recoverParse(grammar, input);
+            if (recovered.tree != nullptr) {
+                std::cout << "Recovered as \"" << recovered.input << "\":" << std::endl;
+                egp::printParseTree(recovered.tree, true);
+            }
+            std::cout << std::endl;
             continue;
         }
 
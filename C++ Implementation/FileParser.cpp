@@ -0,0 +1,259 @@
+#include "FileParser.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace egp;
+
+namespace
+{
+	// A growing array in a spill file
+	template<typename T>
+	class SpillArray
+	{
+	public:
+		T* data() const { return reinterpret_cast<T*>(file.data()); }
+		std::size_t size() const { return count; }
+		std::size_t bytes() const { return file.size(); }
+
+		void append(const T* values, std::size_t n)
+		{
+			file.resize((count + n) * sizeof(T));
+			std::memcpy(file.data() + count * sizeof(T), values, n * sizeof(T));
+			count += n;
+		}
+
+	private:
+		SpillFile file;
+		std::size_t count = 0;
+	};
+
+	// Rules of the start symbol and its inlined helpers, whose items started
+	// at 0 make up the top level
+	std::vector<bool> topLevelRules(const CompiledGrammar& cg)
+	{
+		int startSymbol = cg.header->startSymbol;
+		std::string helperPrefix = std::string(cg.names + cg.nameOffsets[startSymbol]) + "#";
+		std::vector<bool> topLevel(cg.header->ruleCount);
+		for (int rule = 0; rule < cg.header->ruleCount; rule++) {
+			topLevel[rule] = cg.ruleLhs[rule] == startSymbol ||
+				((cg.ruleFlags[rule] & RULE_FLAG_INLINED) && std::string(ruleName(cg, rule)).compare(0, helperPrefix.length(), helperPrefix) == 0);
+		}
+		return topLevel;
+	}
+
+	// Tree of rule over [first, last) from just the sets in between
+	ParseNode* buildPackedTree(std::string_view input, std::uint32_t first, std::uint32_t last, int rule,
+							   const Grammar& g, const Lr0Items& lr0, const PackedOriginsFunc& origins, const ParseLimits& limits)
+	{
+		EarlyVec inverted(last - first + 1);
+		for (std::uint32_t k = last + 1; k-- > first;) {
+			for (auto item = origins(k).first; item != origins(k).second; ++item) {
+				int itemRule = lr0.rule[item->item];
+				if (lr0.postdot[item->item] == COMPLETED && item->origin >= first)
+					inverted[item->origin - first].push_back({ itemRule, (int)item->item - lr0.first[itemRule], (int)(k - first) }); // EarlyItem: {rule, next, start}
+			}
+		}
+		Edge<int> edge = { 0, int(last - first), rule };
+		try {
+			return buildSpanTree(input.substr(first, last - first), inverted, g, edge, ReuseFunc(), limits);
+		}
+		catch (ParseError& error) {
+			error.position += first;
+			throw;
+		}
+	}
+}
+
+bool egp::parseFile(const std::string& path, const Grammar& g, const CompiledGrammar& cg,
+					const RecordFunc& onRecord, FileParseStats* stats)
+{
+	return parseFile(path, g, cg, onRecord, ParseLimits(), stats);
+}
+
+bool egp::parseFile(const std::string& path, const Grammar& g, const CompiledGrammar& cg,
+					const RecordFunc& onRecord, const ParseLimits& limits, FileParseStats* stats)
+{
+	MappedFile file(path);
+	std::string_view input(file.data(), file.size());
+	if (input.length() >= UINT32_MAX)
+		throw "file is too large for a packed chart";
+
+	Lr0Items lr0 = buildLr0Items(cg);
+	std::vector<bool> topLevel = topLevelRules(cg);
+	FileParseStats counted;
+
+	// The chart, sets back to back with an offset per set as in a PackedChart
+	SpillArray<PackedItem> items;
+	SpillArray<std::uint64_t> offsets;
+	std::uint64_t end = 0;
+	offsets.append(&end, 1);
+	PackedOriginsFunc origins = [&items, &offsets](std::uint32_t k) {
+		const std::uint64_t* offset = offsets.data() + k;
+		return std::make_pair(items.data() + offset[0], items.data() + offset[1]);
+	};
+
+	auto completed = [&lr0](const PackedItem& item) { return lr0.postdot[item.item] == COMPLETED; };
+	auto isTopLevel = [&lr0, &topLevel](const PackedItem& item) { return item.origin == 0 && topLevel[lr0.rule[item.item]]; };
+
+	auto buildRecord = [&](std::uint32_t first, std::uint32_t last, int rule) {
+		return buildPackedTree(input, first, last, rule, g, lr0, origins, limits);
+	};
+
+	// Hands over the records between two cuts: a path of completed items
+	// for the nonterminals the top level waits for at first
+	auto emitRecords = [&](std::uint32_t first, std::uint32_t last) {
+		std::vector<std::int32_t> symbols;
+		for (auto item = origins(first).first; item != origins(first).second; ++item) {
+			if (isTopLevel(*item) && lr0.postdot[item->item] >= 0 && !completed(*item))
+				symbols.push_back(lr0.postdot[item->item]);
+		}
+
+		std::vector<std::pair<std::uint32_t, int>> path;	// record start and rule, from the end
+		std::vector<bool> failed(last - first);
+		std::function<bool(std::uint32_t)> search = [&](std::uint32_t position) {
+			if (position == first)
+				return true;
+			for (auto item = origins(position).first; item != origins(position).second; ++item) {
+				int rule = lr0.rule[item->item];
+				if (!completed(*item) || item->origin < first || item->origin == position || failed[item->origin - first] ||
+					std::find(symbols.begin(), symbols.end(), cg.ruleLhs[rule]) == symbols.end())
+					continue;
+				path.push_back({ item->origin, rule });
+				if (search(item->origin))
+					return true;
+				path.pop_back();
+			}
+			failed[position - first] = true;
+			return false;
+		};
+
+		if (!search(last))
+			return;
+		for (std::size_t k = path.size(); k-- > 0;) {
+			std::uint32_t start = path[k].first, stop = k ? path[k - 1].first : last;
+			ParseNode* tree = buildRecord(start, stop, path[k].second);
+			if (tree) {
+				counted.records++;
+				onRecord(tree, start);
+			}
+		}
+	};
+
+	std::uint32_t lastCut = 0;
+	bool accepted = false;
+	std::deque<std::vector<PackedItem>> ahead = startPackedSets(cg, lr0);
+	for (std::uint32_t i = 0; !ahead.empty(); i++) {
+		std::vector<PackedItem> set = std::move(ahead.front());
+		ahead.pop_front();
+		processPackedSet(set, i, ahead, cg, lr0, input, origins);
+		items.append(set.data(), set.size());
+		end = items.size();
+		offsets.append(&end, 1);
+		checkParseLimits(limits, items.size(), items.bytes() + offsets.bytes(), i);
+
+		if (i == input.length()) {
+			accepted = std::any_of(set.begin(), set.end(), [&](const PackedItem& item) {
+				return item.origin == 0 && completed(item) && cg.ruleLhs[lr0.rule[item.item]] == cg.header->startSymbol;
+			});
+		}
+
+		// A cut when nothing but the top level spans position i
+		bool cut = i > lastCut && std::none_of(set.begin(), set.end(), [&](const PackedItem& item) {
+			return item.origin < i && !completed(item) && !isTopLevel(item);
+		});
+		for (std::size_t k = 0; cut && k < ahead.size(); k++) {
+			cut = std::none_of(ahead[k].begin(), ahead[k].end(), [&](const PackedItem& item) {
+				return item.origin < i && !isTopLevel(item);
+			});
+		}
+		if (cut || (accepted && i > lastCut)) {
+			emitRecords(lastCut, i);
+			lastCut = i;
+		}
+	}
+
+	counted.chartBytes = items.bytes() + offsets.bytes();
+	if (stats)
+		*stats = counted;
+	return accepted;
+}
+
+bool egp::parseRecords(std::string_view input, const Grammar& g, const CompiledGrammar& cg,
+					   const RecordFunc& onRecord, RecordParseStats* stats)
+{
+	return parseRecords(input, g, cg, onRecord, ParseLimits(), stats);
+}
+
+bool egp::parseRecords(std::string_view input, const Grammar& g, const CompiledGrammar& cg,
+					   const RecordFunc& onRecord, const ParseLimits& limits, RecordParseStats* stats)
+{
+	Lr0Items lr0 = buildLr0Items(cg);
+	RecordParseStats counted;
+
+	// The chart of the current record, positions relative to its start
+	std::vector<PackedItem> items;
+	std::vector<std::uint32_t> setOffsets;
+	PackedOriginsFunc origins = [&items, &setOffsets](std::uint32_t k) {
+		return std::make_pair(items.data() + setOffsets[k], items.data() + setOffsets[k + 1]);
+	};
+
+	bool accepted = true;
+	for (std::size_t base = 0; base < input.length();) {
+		std::string_view rest = input.substr(base);
+		items.clear();
+		setOffsets.assign(1, 0);
+
+		// Run the chart until no item is left; the record ends at the last
+		// completion of the start rule, which is the point where nothing else
+		// spans it unless the items after it died out again
+		std::uint32_t last = 0;
+		int lastRule = -1;
+		std::deque<std::vector<PackedItem>> ahead = startPackedSets(cg, lr0);
+		for (std::uint32_t i = 0; !ahead.empty(); i++) {
+			if (i == UINT32_MAX)
+				throw "record is too long for a packed chart";
+			std::vector<PackedItem> set = std::move(ahead.front());
+			ahead.pop_front();
+			processPackedSet(set, i, ahead, cg, lr0, rest, origins);
+			items.insert(items.end(), set.begin(), set.end());
+			setOffsets.push_back(items.size());
+			checkParseLimits(limits, items.size(),
+				items.capacity() * sizeof(PackedItem) + setOffsets.capacity() * sizeof(std::uint32_t), base + i);
+
+			for (const PackedItem& item : set) {
+				int rule = lr0.rule[item.item];
+				if (i > 0 && item.origin == 0 && lr0.postdot[item.item] == COMPLETED && cg.ruleLhs[rule] == cg.header->startSymbol) {
+					last = i;
+					lastRule = rule;
+					break;
+				}
+			}
+		}
+
+		counted.peakChartBytes = std::max(counted.peakChartBytes,
+			items.capacity() * sizeof(PackedItem) + setOffsets.capacity() * sizeof(std::uint32_t));
+		if (lastRule == -1) {
+			accepted = false;
+			break;
+		}
+
+		ParseNode* tree;
+		try {
+			tree = buildPackedTree(rest, 0, last, lastRule, g, lr0, origins, limits);
+		}
+		catch (ParseError& error) {
+			error.position += base;
+			throw;
+		}
+		if (tree) {
+			counted.records++;
+			onRecord(tree, base);
+		}
+		base += last;
+	}
+
+	if (stats)
+		*stats = counted;
+	return accepted;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "PackedChart.h"
+#include "GrammarParser.h"
+
+namespace egp
+{
+	// Called with the tree of every record and its offset in the input. The
+	// callback owns the tree; its tokens refer to the input or mapped file,
+	// so use ownTokenLabels on a tree that is kept after parsing.
+	typedef std::function<void(ParseNode* record, std::size_t offset)> RecordFunc;
+
+	struct FileParseStats
+	{
+		std::size_t records = 0;
+		std::size_t chartBytes = 0;		// written to the spill files
+	};
+
+	struct RecordParseStats
+	{
+		std::size_t records = 0;
+		std::size_t peakChartBytes = 0;	// of the largest record
+	};
+
+	// Parses a file too large for memory, such as a log of several GB, whose
+	// start rule repeats a record: File -> File Record | Record, or the
+	// same written as File -> Record+. The file is mapped instead of read
+	// and the packed chart is written to temporary spill files, so neither
+	// has to be resident at once.
+	//
+	// Records are handed to onRecord as soon as they are certain: when the
+	// only items spanning the end of a record are the top-level ones of the
+	// start rule (its own rules and its inlined helpers, started at 0). The
+	// tree of a record is built from just its part of the chart.
+	//
+	// g and cg must be the same grammar, see compileGrammar. The packed
+	// chart limits the file to 4 GB. Returns whether the whole file parsed;
+	// the records before an error have been handed over already.
+	bool parseFile(const std::string& path, const Grammar& g, const CompiledGrammar& cg,
+				   const RecordFunc& onRecord, FileParseStats* stats = nullptr);
+	// Throw ParseError when the chart goes over limits, its bytes being the
+	// ones written to the spill files, or a tree is built past the deadline
+	// or cancelled
+	bool parseFile(const std::string& path, const Grammar& g, const CompiledGrammar& cg,
+				   const RecordFunc& onRecord, const ParseLimits& limits, FileParseStats* stats = nullptr);
+
+	// Parses input as records one after the other, each matched by the
+	// start rule on its own: write Record, not File -> Record+. A record
+	// ends where its start rule completed last before the chart ran out of
+	// items, then it is handed to onRecord and the chart starts over. Since
+	// the chart only ever holds one record, memory and the time until a
+	// record is handed over depend on the size of a record and not on the
+	// input, which may be a MappedFile of any size.
+	//
+	// Records are as long as possible: one the start rule could still extend
+	// is handed over once the items after it died out, and an empty match
+	// of the start rule is not a record. Returns whether all of input was
+	// matched; the records before an error have been handed over already.
+	bool parseRecords(std::string_view input, const Grammar& g, const CompiledGrammar& cg,
+					  const RecordFunc& onRecord, RecordParseStats* stats = nullptr);
+	// The item and chart limits are for the chart of one record, the
+	// deadline and cancellation for the whole input
+	bool parseRecords(std::string_view input, const Grammar& g, const CompiledGrammar& cg,
+					  const RecordFunc& onRecord, const ParseLimits& limits, RecordParseStats* stats = nullptr);
+}
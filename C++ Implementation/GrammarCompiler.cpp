@@ -0,0 +1,405 @@
+#include "GrammarCompiler.h"
+#include "MappedFile.h"
+#include "Terminal.h"
+#include "NonTerminal.h"
+#include <typeinfo>
+#include <unordered_map>
+#include <fstream>
+#include <cstring>
+
+using namespace egp;
+
+CompiledGrammar egp::compileGrammar(const Grammar& g)
+{
+	std::vector<std::string> names;
+	std::unordered_map<std::string, int> ids;
+	auto symbolId = [&names, &ids](const std::string& name) -> int {
+		auto it = ids.find(name);
+		if (it != ids.end())
+			return it->second;
+		ids[name] = names.size();
+		names.push_back(name);
+		return names.size() - 1;
+	};
+
+	int startSymbol = symbolId(g.startRule);
+	for (const Rule& rule : g.rules)
+		symbolId(rule.name);
+
+	// Flatten every rule definition into rhs, sharing
+	// one terminal class between identical terminals
+	std::vector<std::int32_t> ruleLhs, ruleOffsets = { 0 }, rhs;
+	std::vector<std::uint8_t> ruleFlags, terminalFlags;
+	std::vector<std::vector<CharRange>> terminalRanges;
+	auto sameRanges = [](const std::vector<CharRange>& a, const std::vector<CharRange>& b) {
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const CharRange& x, const CharRange& y) {
+			return x.first == y.first && x.last == y.last;
+		});
+	};
+	std::vector<std::int32_t> rulePrecedence;
+	for (const Rule& rule : g.rules) {
+		ruleLhs.push_back(ids[rule.name]);
+		ruleFlags.push_back((rule.inlined ? RULE_FLAG_INLINED : 0) |
+			(rule.associativity == ASSOC_LEFT ? RULE_FLAG_LEFT : rule.associativity == ASSOC_RIGHT ? RULE_FLAG_RIGHT : 0));
+		rulePrecedence.push_back(rule.precedence);
+		for (Symbol* symbol : rule.definition) {
+			if (typeid(*symbol) == typeid(Terminal)) {
+				const Terminal* terminal = static_cast<const Terminal*>(symbol);
+				std::vector<CharRange> matched = terminal->getMatchedRanges();
+				std::uint8_t flags = terminal->isRun() ? TERMINAL_FLAG_RUN : 0;
+
+				std::size_t t = 0;
+				while (t < terminalRanges.size() && !(terminalFlags[t] == flags && sameRanges(terminalRanges[t], matched)))
+					++t;
+				if (t == terminalRanges.size()) {
+					terminalRanges.push_back(matched);
+					terminalFlags.push_back(flags);
+				}
+				rhs.push_back(encodeTerminal(t));
+			}
+			else if (typeid(*symbol) == typeid(NonTerminal)) {
+				if (symbol->getSymbols().size() != 1)
+					throw "unsupported nonterminal set";
+				rhs.push_back(symbolId(*symbol->getSymbols().begin()));
+			}
+			else
+				throw "illegal rule";
+		}
+		ruleOffsets.push_back(rhs.size());
+	}
+
+	int ruleCount = ruleLhs.size();
+	int nonTerminalCount = names.size();
+
+	std::vector<TerminalBitmap> terminals;
+	std::vector<std::int32_t> rangeOffsets = { 0 };
+	std::vector<CharRange> ranges;
+	for (const std::vector<CharRange>& matched : terminalRanges) {
+		TerminalBitmap bitmap = {};
+		for (const CharRange& range : matched) {
+			for (char32_t c = range.first; c <= range.last && c < 256; c++)
+				bitmap.set(c);
+		}
+		terminals.push_back(bitmap);
+		ranges.insert(ranges.end(), matched.begin(), matched.end());
+		rangeOffsets.push_back(ranges.size());
+	}
+
+	std::vector<std::uint8_t> nullable(nonTerminalCount, 0);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int r = 0; r < ruleCount; r++) {
+			if (nullable[ruleLhs[r]])
+				continue;
+			int k = ruleOffsets[r];
+			while (k < ruleOffsets[r + 1] && rhs[k] >= 0 && nullable[rhs[k]])
+				++k;
+			if (k == ruleOffsets[r + 1]) {
+				nullable[ruleLhs[r]] = 1;
+				changed = true;
+			}
+		}
+	}
+
+	for (int r = 0; r < ruleCount; r++) {
+		int k = ruleOffsets[r];
+		while (k < ruleOffsets[r + 1] && rhs[k] >= 0 && nullable[rhs[k]])
+			++k;
+		if (k == ruleOffsets[r + 1])
+			ruleFlags[r] |= RULE_FLAG_NULLABLE;
+	}
+
+	// The bytes a match of each rule can start with. A code point below 256
+	// may also be a malformed byte of that value, see decodeUtf8, the others
+	// start with the lead byte of their encoding.
+	std::vector<TerminalBitmap> terminalFirst = terminals;
+	for (std::size_t t = 0; t < terminalRanges.size(); t++) {
+		for (const CharRange& range : terminalRanges[t]) {
+			if (range.last < 0x80)
+				continue;
+			unsigned char first = encodeUtf8(std::max<char32_t>(range.first, 0x80))[0];
+			unsigned char last = encodeUtf8(std::min<char32_t>(range.last, 0x10FFFF))[0];
+			for (unsigned c = first; c <= last; c++)
+				terminalFirst[t].set(c);
+		}
+	}
+
+	auto addBytes = [](TerminalBitmap& to, const TerminalBitmap& from) {
+		bool added = false;
+		for (int k = 0; k < 8; k++) {
+			added = added || (from.bits[k] & ~to.bits[k]);
+			to.bits[k] |= from.bits[k];
+		}
+		return added;
+	};
+	std::vector<TerminalBitmap> first(nonTerminalCount, TerminalBitmap()), ruleFirst(ruleCount, TerminalBitmap());
+	changed = true;
+	while (changed) {
+		changed = false;
+		for (int r = 0; r < ruleCount; r++) {
+			for (int k = ruleOffsets[r]; k < ruleOffsets[r + 1]; k++) {
+				if (rhs[k] < 0) {
+					addBytes(ruleFirst[r], terminalFirst[decodeTerminal(rhs[k])]);
+					break;
+				}
+				addBytes(ruleFirst[r], first[rhs[k]]);
+				if (!nullable[rhs[k]])
+					break;
+			}
+			changed = addBytes(first[ruleLhs[r]], ruleFirst[r]) || changed;
+		}
+	}
+
+	std::vector<std::vector<int>> rulesOf(nonTerminalCount);
+	for (int r = 0; r < ruleCount; r++)
+		rulesOf[ruleLhs[r]].push_back(r);
+
+	// The prediction closure of a nonterminal is every rule of every
+	// nonterminal that can appear leftmost in one of its derivations, less
+	// the rules precedenceAllows keeps out of the operand they would be.
+	// Closed a rule at a time, so a rule without precedence in between
+	// takes any operand again.
+	auto closeRules = [&](std::vector<std::int32_t> closure) {
+		std::vector<bool> reached(ruleCount, false);
+		for (std::int32_t r : closure)
+			reached[r] = true;
+		for (std::size_t k = 0; k < closure.size(); k++) {
+			int r = closure[k];
+			for (int p = ruleOffsets[r]; p < ruleOffsets[r + 1] && rhs[p] >= 0; p++) {
+				for (int c : rulesOf[rhs[p]]) {
+					if (!reached[c] && precedenceAllows(g, r, p - ruleOffsets[r], c)) {
+						reached[c] = true;
+						closure.push_back(c);
+					}
+				}
+				if (!nullable[rhs[p]])
+					break;
+			}
+		}
+		std::sort(closure.begin(), closure.end());
+		return closure;
+	};
+
+	std::vector<std::int32_t> predictOffsets = { 0 }, predictRules;
+	for (int n = 0; n < nonTerminalCount; n++) {
+		std::vector<std::int32_t> closure = closeRules({ rulesOf[n].begin(), rulesOf[n].end() });
+		predictRules.insert(predictRules.end(), closure.begin(), closure.end());
+		predictOffsets.push_back(predictRules.size());
+	}
+
+	// The right operand of an operator rule predicts only the rules that
+	// bind tighter, see predictRange
+	std::vector<std::int32_t> operandOffsets = { (std::int32_t)predictRules.size() };
+	for (int r = 0; r < ruleCount; r++) {
+		int last = ruleOffsets[r + 1] - 1;
+		if (g.rules[r].precedence && last > ruleOffsets[r] && rhs[last] >= 0) {
+			std::vector<std::int32_t> operands;
+			for (int c : rulesOf[rhs[last]]) {
+				if (precedenceAllows(g, r, last - ruleOffsets[r], c))
+					operands.push_back(c);
+			}
+			std::vector<std::int32_t> closure = closeRules(operands);
+			predictRules.insert(predictRules.end(), closure.begin(), closure.end());
+		}
+		operandOffsets.push_back(predictRules.size());
+	}
+
+	std::vector<std::int32_t> nameOffsets;
+	std::string nameData;
+	for (const std::string& name : names) {
+		nameOffsets.push_back(nameData.size());
+		nameData += name;
+		nameData.push_back('\0');
+	}
+
+	// Lay out the image: header first, then each section aligned to 8 bytes
+	auto image = std::make_shared<std::vector<char>>(sizeof(CompiledHeader));
+	CompiledHeader header = {};
+	header.magic = COMPILED_GRAMMAR_MAGIC;
+	header.version = COMPILED_GRAMMAR_VERSION;
+	header.startSymbol = startSymbol;
+	header.nonTerminalCount = nonTerminalCount;
+	header.terminalCount = terminals.size();
+	header.ruleCount = ruleCount;
+	header.rhsCount = rhs.size();
+	header.predictCount = predictRules.size();
+	header.rangeCount = ranges.size();
+
+	auto addSection = [&image, &header](CompiledSection section, const void* data, std::size_t bytes) {
+		image->resize((image->size() + 7) & ~std::size_t(7));
+		header.sectionOffset[section] = image->size();
+		header.sectionSize[section] = bytes;
+		image->insert(image->end(), static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+	};
+
+	addSection(SECTION_NAME_OFFSETS, nameOffsets.data(), nameOffsets.size() * sizeof(std::int32_t));
+	addSection(SECTION_NAMES, nameData.data(), nameData.size());
+	addSection(SECTION_RULE_LHS, ruleLhs.data(), ruleLhs.size() * sizeof(std::int32_t));
+	addSection(SECTION_RULE_OFFSETS, ruleOffsets.data(), ruleOffsets.size() * sizeof(std::int32_t));
+	addSection(SECTION_RHS, rhs.data(), rhs.size() * sizeof(std::int32_t));
+	addSection(SECTION_TERMINALS, terminals.data(), terminals.size() * sizeof(TerminalBitmap));
+	addSection(SECTION_NULLABLE, nullable.data(), nullable.size());
+	addSection(SECTION_PREDICT_OFFSETS, predictOffsets.data(), predictOffsets.size() * sizeof(std::int32_t));
+	addSection(SECTION_PREDICT_RULES, predictRules.data(), predictRules.size() * sizeof(std::int32_t));
+	addSection(SECTION_RULE_FLAGS, ruleFlags.data(), ruleFlags.size());
+	addSection(SECTION_RANGE_OFFSETS, rangeOffsets.data(), rangeOffsets.size() * sizeof(std::int32_t));
+	addSection(SECTION_RANGES, ranges.data(), ranges.size() * sizeof(CharRange));
+	addSection(SECTION_TERMINAL_FLAGS, terminalFlags.data(), terminalFlags.size());
+	addSection(SECTION_RULE_FIRST, ruleFirst.data(), ruleFirst.size() * sizeof(TerminalBitmap));
+	addSection(SECTION_RULE_PRECEDENCE, rulePrecedence.data(), rulePrecedence.size() * sizeof(std::int32_t));
+	addSection(SECTION_OPERAND_OFFSETS, operandOffsets.data(), operandOffsets.size() * sizeof(std::int32_t));
+
+	header.imageSize = image->size();
+	std::memcpy(image->data(), &header, sizeof(header));
+	return bindCompiledGrammar(image->data(), image->size(), image);
+}
+
+CompiledGrammar egp::bindCompiledGrammar(const char* image, std::size_t size, std::shared_ptr<const void> storage)
+{
+	if (size < sizeof(CompiledHeader) || reinterpret_cast<std::uintptr_t>(image) % 8)
+		throw "invalid grammar image";
+
+	const CompiledHeader* header = reinterpret_cast<const CompiledHeader*>(image);
+	if (header->magic != COMPILED_GRAMMAR_MAGIC)
+		throw "invalid grammar image";
+	if (header->version != COMPILED_GRAMMAR_VERSION)
+		throw "unsupported grammar image version";
+	if (header->imageSize > size || header->nonTerminalCount <= 0 || header->ruleCount < 0 ||
+		header->terminalCount < 0 || header->rhsCount < 0 || header->predictCount < 0 || header->rangeCount < 0 ||
+		header->startSymbol < 0 || header->startSymbol >= header->nonTerminalCount)
+		throw "invalid grammar image";
+
+	std::size_t nt = header->nonTerminalCount;
+	std::size_t expectedSize[SECTION_COUNT] = {
+		nt * sizeof(std::int32_t),
+		header->sectionSize[SECTION_NAMES],
+		header->ruleCount * sizeof(std::int32_t),
+		(header->ruleCount + 1) * sizeof(std::int32_t),
+		header->rhsCount * sizeof(std::int32_t),
+		header->terminalCount * sizeof(TerminalBitmap),
+		nt * sizeof(std::uint8_t),
+		(nt + 1) * sizeof(std::int32_t),
+		header->predictCount * sizeof(std::int32_t),
+		header->ruleCount * sizeof(std::uint8_t),
+		(header->terminalCount + 1) * sizeof(std::int32_t),
+		header->rangeCount * sizeof(CharRange),
+		header->terminalCount * sizeof(std::uint8_t),
+		header->ruleCount * sizeof(TerminalBitmap),
+		header->ruleCount * sizeof(std::int32_t),
+		(header->ruleCount + 1) * sizeof(std::int32_t)
+	};
+
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		std::size_t offset = header->sectionOffset[i];
+		if (offset % 8 || header->sectionSize[i] != expectedSize[i] ||
+			offset > header->imageSize || header->imageSize - offset < expectedSize[i])
+			throw "invalid grammar image";
+	}
+
+	CompiledGrammar cg;
+	cg.header = header;
+	cg.nameOffsets = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_NAME_OFFSETS]);
+	cg.names = image + header->sectionOffset[SECTION_NAMES];
+	cg.ruleLhs = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_RULE_LHS]);
+	cg.ruleOffsets = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_RULE_OFFSETS]);
+	cg.rhs = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_RHS]);
+	cg.terminals = reinterpret_cast<const TerminalBitmap*>(image + header->sectionOffset[SECTION_TERMINALS]);
+	cg.nullable = reinterpret_cast<const std::uint8_t*>(image + header->sectionOffset[SECTION_NULLABLE]);
+	cg.predictOffsets = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_PREDICT_OFFSETS]);
+	cg.predictRules = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_PREDICT_RULES]);
+	cg.ruleFlags = reinterpret_cast<const std::uint8_t*>(image + header->sectionOffset[SECTION_RULE_FLAGS]);
+	cg.rangeOffsets = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_RANGE_OFFSETS]);
+	cg.ranges = reinterpret_cast<const CharRange*>(image + header->sectionOffset[SECTION_RANGES]);
+	cg.terminalFlags = reinterpret_cast<const std::uint8_t*>(image + header->sectionOffset[SECTION_TERMINAL_FLAGS]);
+	cg.ruleFirst = reinterpret_cast<const TerminalBitmap*>(image + header->sectionOffset[SECTION_RULE_FIRST]);
+	cg.rulePrecedence = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_RULE_PRECEDENCE]);
+	cg.operandOffsets = reinterpret_cast<const std::int32_t*>(image + header->sectionOffset[SECTION_OPERAND_OFFSETS]);
+	cg.storage = storage;
+	cg.identity = newGrammarIdentity();
+
+	// Cheap consistency checks, the tables themselves are trusted
+	std::size_t namesSize = header->sectionSize[SECTION_NAMES];
+	if (!namesSize || cg.names[namesSize - 1] != '\0' ||
+		cg.ruleOffsets[header->ruleCount] != header->rhsCount ||
+		cg.predictOffsets[nt] != cg.operandOffsets[0] ||
+		cg.operandOffsets[header->ruleCount] != header->predictCount ||
+		cg.rangeOffsets[header->terminalCount] != header->rangeCount)
+		throw "invalid grammar image";
+
+	return cg;
+}
+
+void egp::writeCompiledGrammar(const CompiledGrammar& cg, const std::string& path)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw "unable to open file";
+	file.write(reinterpret_cast<const char*>(cg.header), cg.header->imageSize);
+	if (!file)
+		throw "unable to write file";
+}
+
+CompiledGrammar egp::loadCompiledGrammar(const std::string& path)
+{
+	auto file = std::make_shared<MappedFile>(path);
+	return bindCompiledGrammar(file->data(), file->size(), file);
+}
+
+Grammar egp::decompileGrammar(const CompiledGrammar& cg)
+{
+	std::vector<Symbol*> terminals;
+	for (int t = 0; t < cg.header->terminalCount; t++) {
+		std::vector<CharRange> ranges(cg.ranges + cg.rangeOffsets[t], cg.ranges + cg.rangeOffsets[t + 1]);
+		terminals.push_back(new Terminal(ranges, false, (cg.terminalFlags[t] & TERMINAL_FLAG_RUN) != 0));
+	}
+
+	Grammar g;
+	g.startRule = cg.names + cg.nameOffsets[cg.header->startSymbol];
+	for (int r = 0; r < cg.header->ruleCount; r++) {
+		Rule rule = { ruleName(cg, r), {}, (cg.ruleFlags[r] & RULE_FLAG_INLINED) != 0, cg.rulePrecedence[r],
+					  (cg.ruleFlags[r] & RULE_FLAG_LEFT) ? ASSOC_LEFT : (cg.ruleFlags[r] & RULE_FLAG_RIGHT) ? ASSOC_RIGHT : ASSOC_NONE };
+		for (int k = 0; k < ruleLength(cg, r); k++) {
+			std::int32_t symbol = ruleSymbol(cg, r, k);
+			if (symbol < 0)
+				rule.definition.push_back(terminals[decodeTerminal(symbol)]);
+			else
+				rule.definition.push_back(new NonTerminal(cg.names + cg.nameOffsets[symbol]));
+		}
+		g.rules.push_back(rule);
+	}
+	return g;
+}
+
+bool egp::matchTerminal(const CompiledGrammar& cg, int terminal, char32_t c)
+{
+	if (c < 256)
+		return cg.terminals[terminal].match(c);
+
+	const CharRange* first = cg.ranges + cg.rangeOffsets[terminal];
+	const CharRange* last = cg.ranges + cg.rangeOffsets[terminal + 1];
+	const CharRange* it = std::upper_bound(first, last, c, [](char32_t c, const CharRange& range) {
+		return c < range.first;
+	});
+	return it != first && c <= (it - 1)->last;
+}
+
+std::size_t egp::matchTerminalRun(const CompiledGrammar& cg, int terminal, const char* text, std::size_t length)
+{
+	return matchRun(text, length, cg.ranges + cg.rangeOffsets[terminal], cg.rangeOffsets[terminal + 1] - cg.rangeOffsets[terminal]);
+}
+
+const char* egp::ruleName(const CompiledGrammar& cg, int rule)
+{
+	return cg.names + cg.nameOffsets[cg.ruleLhs[rule]];
+}
+
+int egp::ruleLength(const CompiledGrammar& cg, int rule)
+{
+	return cg.ruleOffsets[rule + 1] - cg.ruleOffsets[rule];
+}
+
+std::int32_t egp::ruleSymbol(const CompiledGrammar& cg, int rule, int position)
+{
+	return cg.rhs[cg.ruleOffsets[rule] + position];
+}
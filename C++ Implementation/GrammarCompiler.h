@@ -0,0 +1,150 @@
+#pragma once
+#include "GrammarRecognizer.h"
+#include "Utf8.h"
+#include <cstdint>
+#include <memory>
+
+namespace egp
+{
+	// A CompiledGrammar is a Grammar flattened into integer tables inside a
+	// single contiguous image. Building one resolves every rule name to a
+	// symbol id, turns every Terminal into sorted code point ranges (plus
+	// a bitmap for code points below 256) and precomputes the nullable set
+	// and the prediction closure of every nonterminal and the bytes every
+	// rule can start with, so none of that work is repeated per parse.
+	//
+	// The image can be written to disk and loaded again with mmap. Loading
+	// only validates the header and points the tables into the mapping;
+	// nothing is parsed or copied. Images use the native byte order.
+	//
+	// Rule indices are preserved, so charts built from a CompiledGrammar
+	// can be handed to the GrammarParser functions together with the
+	// Grammar it was compiled from (or decompileGrammar()'s result).
+
+	const std::uint32_t COMPILED_GRAMMAR_MAGIC = 0x43504745; // "EGPC"
+	const std::uint32_t COMPILED_GRAMMAR_VERSION = 5;
+
+	enum CompiledSection
+	{
+		SECTION_NAME_OFFSETS,	// int32 per nonterminal, offset into SECTION_NAMES
+		SECTION_NAMES,			// NUL terminated nonterminal names
+		SECTION_RULE_LHS,		// int32 per rule, nonterminal id
+		SECTION_RULE_OFFSETS,	// int32 per rule + 1, offset into SECTION_RHS
+		SECTION_RHS,			// int32 per symbol, see encodeTerminal()
+		SECTION_TERMINALS,		// TerminalBitmap per terminal class, code points < 256
+		SECTION_NULLABLE,		// uint8 per nonterminal
+		SECTION_PREDICT_OFFSETS,// int32 per nonterminal + 1, offset into SECTION_PREDICT_RULES
+		SECTION_PREDICT_RULES,	// rules predicted (transitively) by each nonterminal, then by each right operand
+		SECTION_RULE_FLAGS,		// uint8 per rule, RULE_FLAG_* bits
+		SECTION_RANGE_OFFSETS,	// int32 per terminal class + 1, offset into SECTION_RANGES
+		SECTION_RANGES,			// CharRange, every code point range matched by each class
+		SECTION_TERMINAL_FLAGS,	// uint8 per terminal class, TERMINAL_FLAG_* bits
+		SECTION_RULE_FIRST,		// TerminalBitmap per rule, first bytes of its nonempty matches
+		SECTION_RULE_PRECEDENCE,// int32 per rule, see Rule::precedence
+		SECTION_OPERAND_OFFSETS,// int32 per rule + 1, offset into SECTION_PREDICT_RULES
+		SECTION_COUNT
+	};
+
+	const std::uint8_t RULE_FLAG_INLINED = 1;
+	const std::uint8_t RULE_FLAG_NULLABLE = 2;	// can match the empty string
+	const std::uint8_t RULE_FLAG_LEFT = 4;		// associativity of an operator rule
+	const std::uint8_t RULE_FLAG_RIGHT = 8;
+	const std::uint8_t TERMINAL_FLAG_RUN = 1;
+
+	struct CompiledHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t imageSize;
+		std::int32_t startSymbol;
+		std::int32_t nonTerminalCount;
+		std::int32_t terminalCount;
+		std::int32_t ruleCount;
+		std::int32_t rhsCount;
+		std::int32_t predictCount;
+		std::int32_t rangeCount;
+		std::uint32_t sectionOffset[SECTION_COUNT];
+		std::uint32_t sectionSize[SECTION_COUNT];
+	};
+
+	struct TerminalBitmap
+	{
+		std::uint32_t bits[8];
+
+		bool match(unsigned char c) const { return (bits[c >> 5] >> (c & 31)) & 1; }
+		void set(unsigned char c) { bits[c >> 5] |= std::uint32_t(1) << (c & 31); }
+	};
+
+	struct CompiledGrammar
+	{
+		const CompiledHeader* header = nullptr;
+		const std::int32_t* nameOffsets = nullptr;
+		const char* names = nullptr;
+		const std::int32_t* ruleLhs = nullptr;
+		const std::int32_t* ruleOffsets = nullptr;
+		const std::int32_t* rhs = nullptr;
+		const TerminalBitmap* terminals = nullptr;
+		const std::uint8_t* nullable = nullptr;
+		const std::int32_t* predictOffsets = nullptr;
+		const std::int32_t* predictRules = nullptr;
+		const std::uint8_t* ruleFlags = nullptr;
+		const std::int32_t* rangeOffsets = nullptr;
+		const CharRange* ranges = nullptr;
+		const std::uint8_t* terminalFlags = nullptr;
+		const TerminalBitmap* ruleFirst = nullptr;
+		const std::int32_t* rulePrecedence = nullptr;
+		const std::int32_t* operandOffsets = nullptr;
+
+		// Keeps the image alive, either an owned buffer or a MappedFile.
+		std::shared_ptr<const void> storage;
+		std::uint64_t identity = 0;		// see GrammarIdentity, drawn when the image is bound and shared by copies
+	};
+
+	// Symbols in SECTION_RHS are nonterminal ids when >= 0 and
+	// encoded terminal class ids when < 0.
+	inline std::int32_t encodeTerminal(std::int32_t terminal) { return -1 - terminal; }
+	inline std::int32_t decodeTerminal(std::int32_t symbol) { return -1 - symbol; }
+
+	CompiledGrammar compileGrammar(const Grammar& g);
+	void writeCompiledGrammar(const CompiledGrammar& cg, const std::string& path);
+	CompiledGrammar loadCompiledGrammar(const std::string& path);
+	CompiledGrammar bindCompiledGrammar(const char* image, std::size_t size, std::shared_ptr<const void> storage);
+	Grammar decompileGrammar(const CompiledGrammar& cg);
+
+	bool matchTerminal(const CompiledGrammar& cg, int terminal, char32_t c);
+	std::size_t matchTerminalRun(const CompiledGrammar& cg, int terminal, const char* text, std::size_t length);
+
+	// Whether a prediction of rule at position i of input can lead anywhere:
+	// a rule that does not match empty has to start with the byte at i. The
+	// engines skip the other rules of a prediction closure, which would only
+	// fail to scan.
+	inline bool canPredict(const CompiledGrammar& cg, int rule, std::string_view input, std::size_t i)
+	{
+		return (cg.ruleFlags[rule] & RULE_FLAG_NULLABLE) || (i < input.length() && cg.ruleFirst[rule].match(input[i]));
+	}
+
+	const char* ruleName(const CompiledGrammar& cg, int rule);
+	int ruleLength(const CompiledGrammar& cg, int rule);
+	std::int32_t ruleSymbol(const CompiledGrammar& cg, int rule, int position);
+
+	inline bool precedenceAllows(const CompiledGrammar& cg, int parent, int position, int child)
+	{
+		if (!cg.rulePrecedence[parent])
+			return true;
+		std::uint8_t flags = cg.ruleFlags[parent];
+		Associativity associativity = (flags & RULE_FLAG_LEFT) ? ASSOC_LEFT : (flags & RULE_FLAG_RIGHT) ? ASSOC_RIGHT : ASSOC_NONE;
+		return precedenceAllows(cg.rulePrecedence[parent], associativity, position, ruleLength(cg, parent), cg.rulePrecedence[child]);
+	}
+
+	// The offsets into predictRules of the rules to predict for the symbol
+	// at position of rule. That is the closure of the symbol, or for the
+	// right operand of an operator rule only the rules precedenceAllows
+	// there, so 1+2*3+4 never starts a sum after the first '+'.
+	inline std::pair<int, int> predictRange(const CompiledGrammar& cg, int rule, int position)
+	{
+		if (cg.operandOffsets[rule] != cg.operandOffsets[rule + 1] && position == ruleLength(cg, rule) - 1)
+			return { cg.operandOffsets[rule], cg.operandOffsets[rule + 1] };
+		std::int32_t symbol = ruleSymbol(cg, rule, position);
+		return { cg.predictOffsets[symbol], cg.predictOffsets[symbol + 1] };
+	}
+}
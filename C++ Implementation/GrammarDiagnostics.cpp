@@ -0,0 +1,223 @@
+#include "GrammarDiagnostics.h"
+#include <typeinfo>
+#include <cstdint>
+
+using namespace egp;
+
+namespace
+{
+	// Terminals the items of s[i] are waiting for, in chart order
+	std::vector<const Terminal*> expectedTerminals(const EarlyVec& s, std::size_t i, const Grammar& g)
+	{
+		std::vector<const Terminal*> terminals;
+		std::vector<std::string> names;
+		for (const EarlyItem& item : s[i]) {
+			Symbol* symbol = nextSymbol(g, item);
+			if (symbol == nullptr || typeid(*symbol) != typeid(Terminal))
+				continue;
+
+			std::string name = symbol->toString();
+			if (std::find(names.begin(), names.end(), name) == names.end()) {
+				names.push_back(name);
+				terminals.push_back(static_cast<const Terminal*>(symbol));
+			}
+		}
+		return terminals;
+	}
+
+	// A string the terminal matches, to write into the repaired input
+	std::string sampleText(const Terminal* terminal)
+	{
+		if (!terminal->isClass())
+			return *terminal->getSymbols().begin();
+
+		std::vector<CharRange> ranges = terminal->getMatchedRanges();
+		for (const CharRange& range : ranges) {
+			if (range.last > ' ')
+				return encodeUtf8(std::max<char32_t>(range.first, '!'));
+		}
+		return ranges.empty() ? std::string() : encodeUtf8(ranges[0].first);
+	}
+
+	// Fewest symbols left in a rule of s[i] after scanning terminal, times
+	// two plus one for rules predicted at i so open rules are closed first
+	// and a terminal inserted at i is not inserted again
+	std::size_t symbolsAfter(const EarlyVec& s, std::size_t i, const Terminal* terminal, const Grammar& g)
+	{
+		std::size_t fewest = SIZE_MAX;
+		std::string name = terminal->toString();
+		for (const EarlyItem& item : s[i]) {
+			Symbol* symbol = nextSymbol(g, item);
+			if (symbol != nullptr && typeid(*symbol) == typeid(Terminal) && symbol->toString() == name) {
+				std::size_t left = g.rules[item.rule].definition.size() - item.next - 1;
+				fewest = std::min(fewest, left * 2 + ((std::size_t)item.start == i));
+			}
+		}
+		return fewest;
+	}
+
+	// Advances the items of s[i] waiting for terminal as if it had been
+	// scanned without consuming input, then closes the set again
+	void insertTerminal(EarlyVec& s, std::size_t i, const Terminal* terminal, const Grammar& g,
+						std::string_view input, std::unordered_set<std::string>& nullableRules)
+	{
+		int from = s[i].size();
+		std::string name = terminal->toString();
+		for (int j = 0; j < from; j++) {
+			EarlyItem item = s[i][j];
+			Symbol* symbol = nextSymbol(g, item);
+			if (symbol != nullptr && typeid(*symbol) == typeid(Terminal) && symbol->toString() == name)
+				appendItem(s[i], { item.rule, item.next + 1, item.start });
+		}
+		processSet(s, i, from, g, input, nullableRules);
+	}
+}
+
+bool egp::isAccepted(const EarlyVec& s, const Grammar& g, std::string_view input)
+{
+	if (s.size() <= input.length())
+		return false;
+	for (const EarlyItem& item : s[input.length()]) {
+		const Rule& rule = g.rules[item.rule];
+		if (item.start == 0 && (std::size_t)item.next >= rule.definition.size() && rule.name == g.startRule)
+			return true;
+	}
+	return false;
+}
+
+ParseFailure egp::describeFailure(const EarlyVec& s, const Grammar& g, std::string_view input)
+{
+	ParseFailure failure;
+	std::size_t last = s.size() - 1;
+	while (last > 0 && s[last].empty())
+		--last;
+	failure.position = last;
+
+	for (std::size_t i = 0; i < last;) {
+		char32_t c;
+		if (input[i] == '\n') {
+			++failure.line;
+			failure.column = 1;
+		}
+		else
+			++failure.column;
+		i += decodeUtf8(input.data() + i, input.length() - i, c);
+	}
+
+	if (last < input.length()) {
+		char32_t c;
+		failure.found = input.substr(last, decodeUtf8(input.data() + last, input.length() - last, c));
+	}
+
+	for (const Terminal* terminal : expectedTerminals(s, last, g))
+		failure.expected.push_back(terminal->toString());
+	std::sort(failure.expected.begin(), failure.expected.end());
+	return failure;
+}
+
+std::string egp::formatParseFailure(const ParseFailure& failure)
+{
+	std::string str = std::to_string(failure.line) + ":" + std::to_string(failure.column) + ": unexpected ";
+	str += failure.found.empty() ? "end of input" : "'" + failure.found + "'";
+
+	if (failure.expected.size() == 1)
+		str += ", expected " + failure.expected[0];
+	else if (failure.expected.size() > 1) {
+		str += ", expected one of: ";
+		for (std::size_t i = 0; i < failure.expected.size(); i++)
+			str += (i ? ", " : "") + failure.expected[i];
+	}
+	return str;
+}
+
+RecoveredParse egp::recoverParse(const Grammar& g, std::string_view input, int maxRepairs)
+{
+	return recoverParse(g, input, ParseLimits(), maxRepairs);
+}
+
+RecoveredParse egp::recoverParse(const Grammar& g, std::string_view input, const ParseLimits& limits, int maxRepairs)
+{
+	RecoveredParse result;
+	std::size_t items = 0, bytes = 0;
+	std::unordered_set<std::string> nullableRules = getNullableRules(g);
+	EarlyVec s = { {} };
+
+	for (int i = 0; i < (int)g.rules.size(); i++) {
+		if (g.rules[i].name == g.startRule)
+			s[0].push_back({ i, 0, 0 }); // EarlyItem: {rule, next, start}
+	}
+
+	for (std::size_t i = 0; i < s.size(); i++) {
+		processSet(s, i, 0, g, input, nullableRules);
+
+		// Stuck when nothing got scanned past the last set, or the input is
+		// used up without completing the start rule
+		while (i == s.size() - 1 && result.repairs.size() < (std::size_t)maxRepairs) {
+			bool atEnd = i >= input.length();
+			if (atEnd && isAccepted(s, g, input))
+				break;
+
+			bool repaired = false;
+			std::size_t size = s[i].size();
+			std::vector<const Terminal*> terminals = expectedTerminals(s, i, g);
+			for (const Terminal* terminal : terminals) {
+				insertTerminal(s, i, terminal, g, input, nullableRules);
+				repaired = atEnd ? isAccepted(s, g, input) : s.size() > i + 1;
+				if (repaired) {
+					result.repairs.push_back({ Repair::Insert, i, terminal->toString(), sampleText(terminal) });
+					break;
+				}
+				s[i].resize(size);
+				s.resize(i + 1);
+			}
+			if (repaired)
+				break;
+
+			if (!atEnd) {
+				// skip the code point, the set carries over to the position after it
+				char32_t c;
+				std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+				result.repairs.push_back({ Repair::Skip, i, "", std::string(input.substr(i, length)) });
+				s.resize(i + length + 1);
+				s[i + length] = s[i];
+				break;
+			}
+
+			// at the end no single terminal completes the input, insert the one
+			// that leaves the fewest symbols to go in a rule and try again
+			if (terminals.empty())
+				break;
+			const Terminal* closest = *std::min_element(terminals.begin(), terminals.end(),
+				[&s, i, &g](const Terminal* a, const Terminal* b) {
+					return symbolsAfter(s, i, a, g) < symbolsAfter(s, i, b, g);
+				});
+			insertTerminal(s, i, closest, g, input, nullableRules);
+			result.repairs.push_back({ Repair::Insert, i, closest->toString(), sampleText(closest) });
+		}
+
+		items += s[i].size();
+		bytes += s[i].capacity() * sizeof(EarlyItem);
+		checkParseLimits(limits, items, bytes + s.capacity() * sizeof(EarlySet), i);
+	}
+
+	std::size_t cursor = 0;
+	for (const Repair& repair : result.repairs) {
+		result.input += input.substr(cursor, repair.position - cursor);
+		cursor = repair.position;
+		if (repair.kind == Repair::Insert)
+			result.input += repair.text;
+		else
+			cursor += repair.text.length();
+	}
+	result.input += input.substr(cursor);
+
+	if (!isAccepted(s, g, input))
+		return result;
+
+	EarlyVec repaired = buildItems(g, result.input, limits);
+	EarlyVec inverted = invertEarlyVec(repaired, g);
+	sortEarlyVec(inverted);
+	result.tree = buildParseTree(result.input, inverted, g, limits);
+	ownTokenLabels(result.tree);
+	return result;
+}
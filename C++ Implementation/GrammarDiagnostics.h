@@ -0,0 +1,60 @@
+#pragma once
+#include "GrammarParser.h"
+
+namespace egp
+{
+	// Where and why an input was rejected, read from its Earley chart.
+	// The furthest position is the last non-empty set: no item could scan
+	// past it. The expected terminals are the ones the items of that set
+	// were waiting for.
+	struct ParseFailure
+	{
+		std::size_t position = 0;			// byte offset into the input
+		int line = 1, column = 1;			// 1-based, columns count code points
+		std::string found;					// code point at position, empty at the end of the input
+		std::vector<std::string> expected;	// terminals as printed by Symbol::toString, sorted
+	};
+
+	bool isAccepted(const EarlyVec& s, const Grammar& g, std::string_view input);
+
+	// Only meaningful when the chart does not accept the input
+	ParseFailure describeFailure(const EarlyVec& s, const Grammar& g, std::string_view input);
+
+	// e.g. 1:5: unexpected '*', expected one of: (, [0-9]+
+	std::string formatParseFailure(const ParseFailure& failure);
+
+
+	// One edit made to the input by recoverParse, at a byte offset of the
+	// original input. An inserted terminal is written into the repaired
+	// input as one string it matches (the first printable code point of a
+	// class), a skipped code point is dropped from it.
+	struct Repair
+	{
+		enum Kind { Insert, Skip };
+
+		Kind kind;
+		std::size_t position;
+		std::string terminal;	// inserted terminal, empty for Skip
+		std::string text;		// inserted or skipped text
+	};
+
+	struct RecoveredParse
+	{
+		ParseNode* tree = nullptr;	// nullptr if maxRepairs edits were not enough
+		std::string input;			// the repaired input the tree was built from
+		std::vector<Repair> repairs;
+	};
+
+	// Error recovery mode. The recognizer runs once over the input and, each
+	// time it gets stuck, repairs the input at that point: it inserts the
+	// first expected terminal that lets the next code point scan (or that
+	// completes the start rule at the end of the input), otherwise it skips
+	// the code point. Each repair costs 1 and at most maxRepairs are made.
+	// The tree is then built from the repaired input with the usual parser
+	// functions, so a recovered parse costs about two normal parses.
+	RecoveredParse recoverParse(const Grammar& g, std::string_view input, int maxRepairs = 8);
+	// Throws ParseError when the chart of either pass goes over limits or
+	// the tree is built past the deadline, at a position of the repaired
+	// input for the second pass
+	RecoveredParse recoverParse(const Grammar& g, std::string_view input, const ParseLimits& limits, int maxRepairs = 8);
+}
@@ -78,11 +78,7 @@ const egp::Grammar gi::interpreterGrammar = {
 
 		{
 			"Name",
-			{ new Terminal({"A", "B", "C", "D", "E",
-							"F", "G", "H", "I", "J",
-							"K", "L", "M", "N", "O",
-							"P", "Q", "R", "S", "T",
-							"U", "V", "W", "X", "Y", "Z"}) }
+			{ new Terminal(std::vector<CharRange>{ { 'A', 'Z' } }) }
 		},
 
 		{
@@ -115,16 +111,7 @@ const egp::Grammar gi::interpreterGrammar = {
 
 		{
 			"Letter",
-			{ new Terminal({"a", "b", "c", "d", "e",
-							"f", "g", "h", "i", "j",
-							"k", "l", "m", "n", "o",
-							"p", "q", "r", "s", "t",
-							"u", "v", "w", "x", "y", "z",
-							"A", "B", "C", "D", "E",
-							"F", "G", "H", "I", "J",
-							"K", "L", "M", "N", "O",
-							"P", "Q", "R", "S", "T",
-							"U", "V", "W", "X", "Y", "Z"}) }
+			{ new Terminal(std::vector<CharRange>{ { 'a', 'z' }, { 'A', 'Z' } }) }
 		},
 
 		{
@@ -141,22 +128,32 @@ const egp::Grammar gi::interpreterGrammar = {
 
 		{
 			"Lowercase",
-			{ new Terminal({"a", "b", "c", "d", "e",
-							"f", "g", "h", "i", "j",
-							"k", "l", "m", "n", "o",
-							"p", "q", "r", "s", "t",
-							"u", "v", "w", "x", "y", "z"}) }
+			{ new Terminal(std::vector<CharRange>{ { 'a', 'z' } }) }
 		}
 	}
 };
 
-const egp::ActionVec gi::interpreterActions = {
-	passChildren03, passChildren03, reduceJointExpression,
-	noAction, reduceExpression, reduceExpression, noAction, 
-	noAction, noAction, passChild1, passChild1, passChild0, 
-	combineChildren, passChild0, combineChildren, combineChildren,
-	passChild0, passChild0, passChild0, passChild0
-};
+// The alternatives of a rule are told apart by their number of symbols
+const egp::ActionVec gi::interpreterActions = egp::bindActions(interpreterGrammar, {
+	{ "Rule", passChildren03 },
+	{ "JointExpression", [](const egp::ParseNode& node) {
+		return node.children.size() == 3 ? reduceJointExpression(node) : noAction(node);
+	} },
+	{ "Expression", [](const egp::ParseNode& node) {
+		return node.children.size() == 2 ? reduceExpression(node) : noAction(node);
+	} },
+	{ "NonTerminal", noAction },
+	{ "Terminal", passChild1 },
+	{ "Name", [](const egp::ParseNode& node) {
+		return node.children.size() == 2 ? combineChildren(node) : passChild0(node);
+	} },
+	{ "Word", [](const egp::ParseNode& node) {
+		return node.children.size() == 2 ? combineChildren(node) : passChild0(node);
+	} },
+	{ "Letter", passChild0 },
+	{ "Character", passChild0 },
+	{ "Lowercase", passChild0 }
+});
 
 
 
@@ -185,7 +182,7 @@ egp::ParseNode* gi::noAction(const egp::ParseNode& node) {
 }
 
 egp::ParseNode* gi::combineChildren(const egp::ParseNode& node) {
-	std::string temp = node.children[0]->label + node.children[1]->label;
+	std::string temp = node.children[0]->label.str() + node.children[1]->label.str();
 
 	delete node.children[0]; // Bad design, semantic actions
 	delete node.children[1]; // shouldn't have to mess with 
@@ -195,7 +192,7 @@ egp::ParseNode* gi::combineChildren(const egp::ParseNode& node) {
 }
 
 egp::ParseNode* gi::reduceExpression(const egp::ParseNode& node) {
-	std::vector<egp::ParseNode*> children = { node.children[0] };
+	std::pmr::vector<egp::ParseNode*> children = { node.children[0] };
 	children.insert(children.end(),
 					node.children[1]->children.begin(),
 					node.children[1]->children.end());
@@ -208,7 +205,7 @@ egp::ParseNode* gi::reduceExpression(const egp::ParseNode& node) {
 }
 
 egp::ParseNode* gi::reduceJointExpression(const egp::ParseNode& node) {
-	std::vector<egp::ParseNode*> children = { node.children[0] };
+	std::pmr::vector<egp::ParseNode*> children = { node.children[0] };
 	children.insert(children.end(),
 					node.children[2]->children.begin(),
 					node.children[2]->children.end());
@@ -233,7 +230,7 @@ std::vector<egp::Rule> gi::interpretRule(const egp::ParseNode* const simplifiedT
 		throw "invalid parse tree";
 
 	std::vector<egp::Rule> rules;
-	std::string ruleName = ruleNonTerminal->children[0]->label;
+	std::string ruleName = ruleNonTerminal->children[0]->label.str();
 	egp::ParseNode* definition = simplifiedTree->children[1];
 
 	if (definition->label == "Expression")
@@ -264,7 +261,7 @@ egp::Rule gi::buildRule(const std::string& ruleName, const egp::ParseNode* const
 		if (child->children[0]->rule != -1)
 			throw "invalid expression tree";
 
-		std::string token = child->children[0]->label;
+		std::string token = child->children[0]->label.str();
 
 		if (child->rule == NONTERMINAL)
 			definition.push_back(new NonTerminal(token));
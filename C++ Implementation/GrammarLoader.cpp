@@ -0,0 +1,499 @@
+#include "GrammarLoader.h"
+#include "Terminal.h"
+#include "NonTerminal.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <cctype>
+
+using namespace gi;
+
+namespace
+{
+	typedef std::vector<std::vector<Symbol*>> Alternatives;
+
+	// A class by its sorted ranges rather than its printed form, which can
+	// be the same for different classes: [!/-] prints as the range [!-/]
+	struct ClassKey
+	{
+		std::vector<std::pair<char32_t, char32_t>> ranges;
+		bool negated, run;
+
+		explicit ClassKey(const Terminal* terminal, bool run)
+			: negated(terminal->isNegated()), run(run)
+		{
+			for (const CharRange& range : terminal->getRanges())
+				ranges.push_back({ range.first, range.last });
+		}
+
+		bool operator<(const ClassKey& other) const {
+			return std::tie(ranges, negated, run) < std::tie(other.ranges, other.negated, other.run);
+		}
+	};
+
+	struct GrammarReader
+	{
+		std::string_view text;
+		std::size_t pos = 0;
+		egp::Grammar grammar;
+		std::map<std::string, Symbol*> nonTerminals;
+		std::map<std::string, Symbol*> terminals;
+		std::map<ClassKey, Symbol*> classes;
+		std::map<std::string, std::size_t> firstReference;
+		std::map<std::pair<char, Alternatives>, Symbol*> helpers;
+		std::map<const Symbol*, std::pair<char, Alternatives>> helperOperands;
+		std::vector<std::pair<const Symbol*, std::size_t>> repetitions;	// helper of * or +, position of the operator
+		std::map<std::string, int> helperCount;
+		std::vector<egp::Rule> helperRules;
+		std::map<std::string, std::pair<int, egp::Associativity>> operators;
+		std::map<std::size_t, std::pair<std::string, std::size_t>> precOverrides;	// rule index, %prec operator and its position
+
+		GrammarError error(const std::string& message, std::size_t at) const {
+			int line = 1, column = 1;
+			for (std::size_t i = 0; i < at && i < text.size(); i++) {
+				if (text[i] == '\n') {
+					++line;
+					column = 1;
+				}
+				else
+					++column;
+			}
+			return GrammarError(message, line, column);
+		}
+
+		bool atEnd() const { return pos >= text.size(); }
+		char peek() const { return atEnd() ? '\0' : text[pos]; }
+
+		void skipSpace() {
+			while (!atEnd()) {
+				if (std::isspace((unsigned char)text[pos]))
+					++pos;
+				else if (text[pos] == '#')
+					while (!atEnd() && text[pos] != '\n')
+						++pos;
+				else
+					break;
+			}
+		}
+
+		static bool isNameStart(char c) { return std::isalpha((unsigned char)c) || c == '_'; }
+		static bool isNameChar(char c) { return std::isalnum((unsigned char)c) || c == '_'; }
+
+		std::string readName() {
+			std::size_t begin = pos;
+			while (!atEnd() && isNameChar(text[pos]))
+				++pos;
+			return std::string(text.substr(begin, pos - begin));
+		}
+
+		// True if a "Name ->" starts at the current position
+		bool atRuleStart() const {
+			std::size_t i = pos;
+			if (i >= text.size() || !isNameStart(text[i]))
+				return false;
+			while (i < text.size() && isNameChar(text[i]))
+				++i;
+			while (i < text.size() && (text[i] == ' ' || text[i] == '\t'))
+				++i;
+			return text.substr(i, 2) == "->";
+		}
+
+		// Reads up to the closing delimiter, a doubled delimiter stands for itself
+		std::string readDelimited(char close) {
+			std::size_t begin = pos++;
+			std::string chars;
+			while (true) {
+				if (atEnd() || text[pos] == '\n')
+					throw error(std::string("missing closing ") + close, begin);
+				if (text[pos] == close) {
+					if (pos + 1 < text.size() && text[pos + 1] == close) {
+						chars.push_back(close);
+						pos += 2;
+						continue;
+					}
+					++pos;
+					break;
+				}
+				chars.push_back(text[pos++]);
+			}
+			if (chars.empty())
+				throw error("empty terminal", begin);
+			return chars;
+		}
+
+		Symbol* terminal(const std::string& ch) {
+			Symbol*& symbol = terminals[ch];
+			if (!symbol)
+				symbol = new Terminal(ch);
+			return symbol;
+		}
+
+		// [abc], [a-z0-9_] or [^"], over UTF-8 code points. A '-' that
+		// can't form a range (first or last) and a '^' that isn't first
+		// are literal characters.
+		Symbol* readClass() {
+			std::size_t at = pos;
+			std::string chars = readDelimited(']');
+			bool negated = chars.size() > 1 && chars[0] == '^';
+
+			std::vector<char32_t> codePoints;
+			for (std::size_t i = negated ? 1 : 0; i < chars.size();) {
+				char32_t c;
+				i += egp::decodeUtf8(chars.data() + i, chars.size() - i, c);
+				codePoints.push_back(c);
+			}
+
+			std::vector<CharRange> ranges;
+			for (std::size_t i = 0; i < codePoints.size(); i++) {
+				if (i + 2 < codePoints.size() && codePoints[i + 1] == '-') {
+					if (codePoints[i] > codePoints[i + 2])
+						throw error("character range is out of order", at);
+					ranges.push_back({ codePoints[i], codePoints[i + 2] });
+					i += 2;
+				}
+				else
+					ranges.push_back({ codePoints[i], codePoints[i] });
+			}
+
+			Terminal* symbol = new Terminal(ranges, negated);
+			Symbol*& shared = classes[ClassKey(symbol, false)];
+			if (shared)
+				delete symbol;
+			else
+				shared = symbol;
+			return shared;
+		}
+
+		Symbol* nonTerminal(const std::string& name, std::size_t at) {
+			firstReference.emplace(name, at);
+			Symbol*& symbol = nonTerminals[name];
+			if (!symbol)
+				symbol = new NonTerminal(name);
+			return symbol;
+		}
+
+		// Each operator gets one inlined helper rule, shared by every use of the
+		// same operator on the same operand. Repetitions are left recursive,
+		// which Earley handles without extra items, and since the helpers are
+		// inlined a repetition ends up as a flat list in its parent's node.
+		Symbol* helper(const std::string& ruleName, char op, const Alternatives& operand) {
+			Symbol*& symbol = helpers[{ op, operand }];
+			if (symbol)
+				return symbol;
+
+			std::string name = ruleName + "#" + std::to_string(++helperCount[ruleName]);
+			symbol = nonTerminal(name, 0);
+			helperOperands[symbol] = { op, operand };
+
+			for (const std::vector<Symbol*>& alternative : operand) {
+				std::vector<Symbol*> definition;
+				if (op == '*' || op == '+')
+					definition.push_back(symbol);
+				definition.insert(definition.end(), alternative.begin(), alternative.end());
+				helperRules.push_back({ name, definition, true });
+			}
+
+			if (op == '?' || op == '*')
+				helperRules.push_back({ name, {}, true });
+			else if (op == '+')
+				for (const std::vector<Symbol*>& alternative : operand)
+					helperRules.push_back({ name, alternative, true });
+
+			return symbol;
+		}
+
+		// The alternatives of a repeated operand without the ones that match
+		// empty, which would let the helper derive itself (X -> X) and the
+		// tree builder recurse forever. Helpers of a single alternative are
+		// unwrapped, so (a?)* is a*, and ()* repeats nothing. An operand
+		// that is only known to match empty once the whole grammar is read
+		// is rejected by checkRepetitions.
+		Alternatives nonEmpty(const Alternatives& operand, bool& matchesEmpty) const {
+			Alternatives repeated;
+			for (const std::vector<Symbol*>& alternative : operand) {
+				if (alternative.empty()) {
+					matchesEmpty = true;
+					continue;
+				}
+
+				Alternatives unwrapped = { alternative };
+				auto inner = alternative.size() == 1 ? helperOperands.find(alternative[0]) : helperOperands.end();
+				if (inner != helperOperands.end()) {
+					if (inner->second.first == '?' || inner->second.first == '*')
+						matchesEmpty = true;
+					unwrapped = nonEmpty(inner->second.second, matchesEmpty);
+				}
+
+				for (const std::vector<Symbol*>& kept : unwrapped) {
+					if (std::find(repeated.begin(), repeated.end(), kept) == repeated.end())
+						repeated.push_back(kept);
+				}
+			}
+			return repeated;
+		}
+
+		void checkRepetitions() const {
+			std::unordered_set<std::string> nullable = egp::getNullableRules(grammar);
+			for (const std::pair<const Symbol*, std::size_t>& repetition : repetitions) {
+				for (const egp::Rule& rule : grammar.rules) {
+					if (rule.name != repetition.first->toString() || rule.definition.empty() || rule.definition[0] != repetition.first)
+						continue;
+					egp::Rule operand = { rule.name, std::vector<Symbol*>(rule.definition.begin() + 1, rule.definition.end()) };
+					if (egp::isNullable(operand, nullable))
+						throw error("repeated operand can match empty", repetition.second);
+				}
+			}
+		}
+
+		// A repeated character class is scanned as a single run terminal
+		// instead of going through a helper rule one character at a time
+		static Terminal* runnable(const Alternatives& operand) {
+			if (operand.size() != 1 || operand[0].size() != 1)
+				return nullptr;
+			Terminal* terminal = dynamic_cast<Terminal*>(operand[0][0]);
+			if (!terminal || !terminal->isClass() || terminal->isRun())
+				return nullptr;
+			return terminal;
+		}
+
+		Symbol* runOf(const Terminal* terminal) {
+			Symbol*& symbol = classes[ClassKey(terminal, true)];
+			if (!symbol)
+				symbol = new Terminal(terminal->getRanges(), terminal->isNegated(), true);
+			return symbol;
+		}
+
+		// Alternatives of a rule collect their %prec operator in precs, one
+		// per alternative and empty without one; groups take none
+		Alternatives readAlternatives(const std::string& ruleName, std::vector<std::pair<std::string, std::size_t>>* precs = nullptr) {
+			Alternatives alternatives;
+			while (true) {
+				alternatives.push_back(readSequence(ruleName));
+				std::pair<std::string, std::size_t> prec = readPrec(precs != nullptr);
+				if (precs)
+					precs->push_back(prec);
+				if (peek() != '|')
+					return alternatives;
+				++pos;
+			}
+		}
+
+		// %prec "op" after an alternative gives it the precedence of the
+		// declared operator op, for prefix and postfix rules
+		std::pair<std::string, std::size_t> readPrec(bool allowed) {
+			std::size_t at = pos;
+			if (text.substr(pos, 5) != "%prec" || (pos + 5 < text.size() && isNameChar(text[pos + 5])))
+				return {};
+			if (!allowed)
+				throw error("%prec can only end an alternative of a rule", at);
+			pos += 5;
+			while (peek() == ' ' || peek() == '\t')
+				++pos;
+			if (peek() != '"')
+				throw error("expected an operator in quotes", pos);
+			std::string op = readDelimited('"');
+			skipSpace();
+			return { op, at };
+		}
+
+		std::vector<Symbol*> readSequence(const std::string& ruleName) {
+			std::vector<Symbol*> definition;
+			while (true) {
+				skipSpace();
+				char c = peek();
+				std::size_t at = pos;
+				Alternatives operand = { {} };
+
+				if (atEnd() || c == '|' || c == ')' || c == '%' || atRuleStart())
+					return definition;
+				else if (isNameStart(c))
+					operand[0].push_back(nonTerminal(readName(), at));
+				else if (c == '"') {
+					std::string word = readDelimited('"');
+					for (std::size_t i = 0; i < word.size();) {
+						char32_t ch;
+						std::size_t length = egp::decodeUtf8(word.data() + i, word.size() - i, ch);
+						operand[0].push_back(terminal(word.substr(i, length)));
+						i += length;
+					}
+				}
+				else if (c == '[')
+					operand[0].push_back(readClass());
+				else if (c == '(') {
+					++pos;
+					operand = readAlternatives(ruleName);
+					if (peek() != ')')
+						throw error("missing closing )", at);
+					++pos;
+				}
+				else if (c == '*' || c == '+' || c == '?')
+					throw error(std::string("nothing to repeat before '") + c + "'", at);
+				else if (c == '-' && text.substr(pos, 2) == "->")
+					throw error("missing rule name before '->'", at);
+				else
+					throw error(std::string("unexpected character '") + c + "'", at);
+
+				skipSpace();
+				while (peek() == '*' || peek() == '+' || peek() == '?') {
+					std::size_t opAt = pos;
+					char op = text[pos++];
+					if (op == '*' || op == '+') {
+						bool matchesEmpty = false;
+						operand = nonEmpty(operand, matchesEmpty);
+						if (matchesEmpty)
+							op = '*';
+					}
+
+					Terminal* repeated = runnable(operand);
+					if (operand.empty())
+						operand = { {} };
+					else if (repeated && op == '+')
+						operand = { { runOf(repeated) } };
+					else if (repeated && op == '*')
+						operand = { { helper(ruleName, '?', { { runOf(repeated) } }) } };
+					else {
+						operand = { { helper(ruleName, op, operand) } };
+						if (op != '?')
+							repetitions.push_back({ operand[0][0], opAt });
+					}
+					skipSpace();
+				}
+
+				if (operand.size() == 1)
+					definition.insert(definition.end(), operand[0].begin(), operand[0].end());
+				else
+					definition.push_back(helper(ruleName, '(', operand));
+			}
+		}
+
+		void readRule() {
+			std::size_t at = pos;
+			if (!isNameStart(peek()))
+				throw error("expected a rule name", at);
+			std::string name = readName();
+
+			skipSpace();
+			if (text.substr(pos, 2) != "->")
+				throw error("expected '->' after rule name", pos);
+			pos += 2;
+
+			if (grammar.rules.empty())
+				grammar.startRule = name;
+
+			std::vector<std::pair<std::string, std::size_t>> precs;
+			Alternatives alternatives = readAlternatives(name, &precs);
+			for (std::size_t k = 0; k < alternatives.size(); k++) {
+				if (!precs[k].first.empty())
+					precOverrides[grammar.rules.size()] = precs[k];
+				grammar.rules.push_back({ name, alternatives[k] });
+			}
+			if (peek() == ')')
+				throw error("unexpected ')'", pos);
+		}
+
+		// %left "+" "-", every declaration binds tighter than the ones before
+		void readDeclaration() {
+			std::size_t at = pos++;
+			std::string kind = readName();
+			egp::Associativity associativity;
+			if (kind == "left")
+				associativity = egp::ASSOC_LEFT;
+			else if (kind == "right")
+				associativity = egp::ASSOC_RIGHT;
+			else if (kind == "nonassoc")
+				associativity = egp::ASSOC_NONE;
+			else
+				throw error("unknown declaration '%" + kind + "'", at);
+
+			int precedence = operators.size() + 1;
+			std::size_t count = 0;
+			while (true) {
+				while (peek() == ' ' || peek() == '\t')
+					++pos;
+				if (atEnd() || peek() == '\n' || peek() == '\r' || peek() == '#')
+					break;
+				std::size_t operatorAt = pos;
+				if (peek() != '"')
+					throw error("expected an operator in quotes", operatorAt);
+				if (!operators.emplace(readDelimited('"'), std::make_pair(precedence, associativity)).second)
+					throw error("operator is declared twice", operatorAt);
+				++count;
+			}
+			if (!count)
+				throw error("expected an operator in quotes", pos);
+		}
+
+		static bool isInfix(const egp::Rule& rule) {
+			return rule.definition.size() >= 2 && dynamic_cast<const NonTerminal*>(rule.definition.front()) &&
+				dynamic_cast<const NonTerminal*>(rule.definition.back());
+		}
+
+		// A rule with operands at both ends whose terminals spell a declared
+		// operator is an operator rule, as is a rule with %prec. Prefix and
+		// postfix rules only get a precedence by %prec: "-" E must not take
+		// the one of a binary "-", which would change the language.
+		void applyPrecedence() {
+			std::map<const Symbol*, std::string> literals;
+			for (auto it = terminals.begin(); it != terminals.end(); ++it)
+				literals[it->second] = it->first;
+
+			for (std::size_t r = 0; r < grammar.rules.size(); r++) {
+				egp::Rule& rule = grammar.rules[r];
+				auto prec = precOverrides.find(r);
+				std::string spelled;
+				if (prec != precOverrides.end())
+					spelled = prec->second.first;
+				else if (isInfix(rule)) {
+					for (const Symbol* symbol : rule.definition) {
+						auto literal = literals.find(symbol);
+						if (literal != literals.end())
+							spelled += literal->second;
+					}
+				}
+				else
+					continue;
+
+				auto op = operators.find(spelled);
+				if (op != operators.end()) {
+					rule.precedence = op->second.first;
+					rule.associativity = op->second.second;
+				}
+				else if (prec != precOverrides.end())
+					throw error("%prec operator is not declared", prec->second.second);
+			}
+		}
+	};
+}
+
+egp::Grammar gi::loadGrammar(std::string_view text)
+{
+	GrammarReader reader;
+	reader.text = text;
+
+	reader.skipSpace();
+	while (!reader.atEnd()) {
+		if (reader.peek() == '%')
+			reader.readDeclaration();
+		else
+			reader.readRule();
+		reader.skipSpace();
+	}
+
+	if (reader.grammar.rules.empty())
+		throw reader.error("grammar has no rules", 0);
+	reader.applyPrecedence();
+
+	// Helper rules go last so the rules written in the text keep their indices
+	reader.grammar.rules.insert(reader.grammar.rules.end(), reader.helperRules.begin(), reader.helperRules.end());
+
+	std::set<std::string> defined;
+	for (const egp::Rule& rule : reader.grammar.rules)
+		defined.insert(rule.name);
+	for (auto it = reader.firstReference.begin(); it != reader.firstReference.end(); ++it) {
+		if (defined.find(it->first) == defined.end())
+			throw reader.error("undefined rule '" + it->first + "'", it->second);
+	}
+	reader.checkRepetitions();
+
+	return reader.grammar;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "GrammarRecognizer.h"
+#include <stdexcept>
+#include <string_view>
+
+namespace gi
+{
+	struct GrammarError : public std::runtime_error
+	{
+		int line, column;
+
+		GrammarError(const std::string& message, int line, int column)
+			: std::runtime_error(std::to_string(line) + ":" + std::to_string(column) + ": " + message),
+			  line(line), column(column) {}
+	};
+
+	// Reads a whole grammar in one pass, without going through the Earley
+	// pipeline that interpretRule needs for every line. The notation is the
+	// one accepted by interpreterGrammar, with whitespace allowed anywhere:
+	//
+	//	# comments run to the end of the line
+	//	Sum    -> Sum [+-] Product | Product
+	//	Quote  -> """"                 # a doubled delimiter is a literal
+	//	Digits -> Digits [0-9]
+	//	        | [0-9]                # alternatives may continue on new lines
+	//	Text   -> "'" [^']* "'"        # classes take ranges and ^ negation
+	//	Empty  -> "a" Empty |          # an empty alternative matches nothing
+	//	List   -> Item ("," Item)* ";"? # EBNF groups, *, + and ?
+	//	%left "+" "-"                  # operator precedence, see below
+	//	%right "^"
+	//	Expr   -> Expr "+" Expr | Expr "-" Expr | Expr "^" Expr | [0-9]+
+	//
+	// EBNF operators are lowered to inlined helper rules named "Rule#n",
+	// added after the written rules so those keep their indices. Helper
+	// rules never get a ParseNode of their own: a repetition shows up as a
+	// flat run of children in the node of the rule that used it. A class
+	// repeated with + or * becomes a run terminal instead (e.g. [a-z]+),
+	// which is scanned in one step and produces a single token. A repeated
+	// operand never matches empty: alternatives that do are dropped, so
+	// ("a"?)* is "a"* and ()* matches nothing, and an operand that still
+	// could, like (A)* with a nullable A, is a GrammarError.
+	//
+	// %left, %right and %nonassoc declare operators on one line, each line
+	// binding tighter than the ones before it as in yacc. A written rule
+	// with operands at both ends whose terminals spell a declared operator
+	// gets its precedence and associativity, which the parser applies as in
+	// egp::precedenceAllows. Prefix and postfix rules take one by %prec
+	// "op" at the end of the alternative, e.g. E -> "-" E %prec "neg" with
+	// "neg" declared like any operator.
+	//
+	// A rule runs until the next "Name ->" or declaration. The first rule
+	// is the start rule.
+	// Symbols are shared between rules, so the grammar allocates one
+	// NonTerminal per name and one Terminal per distinct character or class.
+	// Classes are matched by code point, see Terminal(std::vector<CharRange>).
+	// Errors are reported as GrammarError with the 1-based line and column.
+	egp::Grammar loadGrammar(std::string_view text);
+}
@@ -0,0 +1,221 @@
+#include "GrammarNormalizer.h"
+#include <typeinfo>
+#include <deque>
+#include <algorithm>
+
+using namespace egp;
+
+namespace
+{
+	const std::string* nonTerminalName(const Symbol* symbol)
+	{
+		if (typeid(*symbol) != typeid(NonTerminal))
+			return nullptr;
+		if (symbol->getSymbols().size() != 1)
+			throw "unsupported nonterminal set";
+		return &*symbol->getSymbols().begin();
+	}
+
+	struct PreRule
+	{
+		std::string name;
+		std::vector<RuleStep> steps;
+		std::vector<Symbol*> definition;
+
+		const std::string* unitName() const { return definition.size() == 1 ? nonTerminalName(definition[0]) : nullptr; }
+	};
+
+	// Appends the empty tree of nonterminal name at offset, or its children
+	// when its rule is inlined
+	void appendEmptyTree(const std::string& name, std::size_t offset, const NormalizedGrammar& ng, std::pmr::vector<ParseNode*>& nodes)
+	{
+		int rule = ng.emptyRules.at(name);
+		const Rule& emptyRule = ng.original.rules[rule];
+		ParseNode* node = new ParseNode(rule, emptyRule.name);
+		for (Symbol* symbol : emptyRule.definition)
+			appendEmptyTree(*nonTerminalName(symbol), 0, ng, node->children);
+
+		if (!emptyRule.inlined) {
+			node->offset = offset;
+			nodes.push_back(node);
+			return;
+		}
+		for (ParseNode* child : node->children) {
+			child->offset += offset;
+			nodes.push_back(child);
+		}
+		delete node;
+	}
+
+	// Appends the original nodes for node, which starts at offset in
+	// their parent, or their children when the outermost rule is inlined
+	void restoreNode(ParseNode* node, const NormalizedGrammar& ng, bool root, std::pmr::vector<ParseNode*>& nodes)
+	{
+		if (node->rule == -1) {
+			nodes.push_back(node);
+			return;
+		}
+
+		const std::vector<RuleStep>& steps = ng.steps[node->rule];
+		std::pmr::vector<ParseNode*> children = std::move(node->children);
+		std::size_t offset = node->offset, length = node->length;
+		std::string name = ng.grammar.rules[node->rule].name;
+		delete node;
+
+		// Innermost rule first, each inside the next; they all span the
+		// same text, so their children are relative to the same offset
+		std::pmr::vector<ParseNode*> inner;
+		if (steps.empty())
+			appendEmptyTree(name, 0, ng, inner);
+		for (std::size_t k = steps.size(); k-- > 0;) {
+			const RuleStep& step = steps[k];
+			const Rule& rule = ng.original.rules[step.rule];
+			std::pmr::vector<ParseNode*> restored;
+			std::size_t next = 0, position = 0;
+			for (std::size_t s = 0; s < rule.definition.size(); s++) {
+				if (!step.kept[s])
+					appendEmptyTree(*nonTerminalName(rule.definition[s]), position, ng, restored);
+				else if (k + 1 < steps.size()) {
+					restored.insert(restored.end(), inner.begin(), inner.end());
+					position = length;
+				}
+				else {
+					position = children[next]->offset + children[next]->length;
+					restoreNode(children[next++], ng, false, restored);
+				}
+			}
+
+			if (rule.inlined && !(root && k == 0)) {
+				inner = std::move(restored);
+				continue;
+			}
+			ParseNode* restoredNode = new ParseNode(step.rule, rule.name, std::move(restored));
+			restoredNode->length = length;
+			inner = { restoredNode };
+		}
+
+		for (ParseNode* restoredNode : inner) {
+			restoredNode->offset += offset;
+			nodes.push_back(restoredNode);
+		}
+	}
+}
+
+NormalizedGrammar egp::normalizeGrammar(const Grammar& g)
+{
+	NormalizedGrammar ng;
+	ng.original = g;
+
+	// The nullable nonterminals, each with the rule that made it nullable
+	// first so its empty tree is finite, and the ones that match nonempty text
+	std::unordered_map<std::string, bool> nonEmpty;
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (int r = 0; r < (int)g.rules.size(); r++) {
+			const Rule& rule = g.rules[r];
+			bool empty = true, text = false;
+			for (Symbol* symbol : rule.definition) {
+				const std::string* name = nonTerminalName(symbol);
+				empty = empty && name && ng.emptyRules.count(*name);
+				text = text || !name || nonEmpty[*name];
+			}
+			if (empty && !ng.emptyRules.count(rule.name)) {
+				ng.emptyRules[rule.name] = r;
+				changed = true;
+			}
+			if (text && !nonEmpty[rule.name]) {
+				nonEmpty[rule.name] = true;
+				changed = true;
+			}
+		}
+	}
+
+	// A rule for every choice of the nullable symbols left out, the
+	// nullable symbols that only match empty are always left out
+	std::vector<PreRule> rules;
+	for (int r = 0; r < (int)g.rules.size(); r++) {
+		const Rule& rule = g.rules[r];
+		std::vector<std::size_t> optional;
+		RuleStep all = { r, std::vector<bool>(rule.definition.size(), true) };
+		for (std::size_t s = 0; s < rule.definition.size(); s++) {
+			const std::string* name = nonTerminalName(rule.definition[s]);
+			if (!name || !ng.emptyRules.count(*name))
+				continue;
+			if (nonEmpty[*name])
+				optional.push_back(s);
+			else
+				all.kept[s] = false;
+		}
+		if (optional.size() > MAX_NULLABLE_CHOICES)
+			throw "rule has too many nullable symbols to normalize";
+
+		for (std::size_t choice = 0; choice < (std::size_t(1) << optional.size()); choice++) {
+			PreRule pre = { rule.name, { all }, {} };
+			for (std::size_t k = 0; k < optional.size(); k++)
+				pre.steps[0].kept[optional[k]] = (choice >> k) & 1;
+			for (std::size_t s = 0; s < rule.definition.size(); s++) {
+				if (pre.steps[0].kept[s])
+					pre.definition.push_back(rule.definition[s]);
+			}
+			if (!pre.definition.empty() && !(pre.unitName() && *pre.unitName() == rule.name))
+				rules.push_back(pre);
+		}
+	}
+
+	// Every nonterminal gets the rules of the ones it reaches through unit
+	// rules, along the shortest chain
+	std::vector<std::string> names;
+	std::unordered_map<std::string, std::vector<std::size_t>> rulesOf;
+	for (std::size_t k = 0; k < rules.size(); k++) {
+		if (!rulesOf.count(rules[k].name))
+			names.push_back(rules[k].name);
+		rulesOf[rules[k].name].push_back(k);
+	}
+
+	// A rule keeps the precedence of the operator rule it ends in, unless
+	// that lost operands
+	auto addRule = [&ng, &g](const std::string& name, std::vector<RuleStep> steps, std::vector<Symbol*> definition) {
+		Rule rule = { name, std::move(definition), false };
+		if (!steps.empty() && std::count(steps.back().kept.begin(), steps.back().kept.end(), false) == 0) {
+			rule.precedence = g.rules[steps.back().rule].precedence;
+			rule.associativity = g.rules[steps.back().rule].associativity;
+		}
+		ng.grammar.rules.push_back(rule);
+		ng.steps.push_back(std::move(steps));
+	};
+
+	for (const std::string& name : names) {
+		std::unordered_map<std::string, std::vector<RuleStep>> chains = { { name, {} } };
+		std::deque<std::string> pending = { name };
+		while (!pending.empty()) {
+			std::string reached = pending.front();
+			pending.pop_front();
+			for (std::size_t k : rulesOf[reached]) {
+				const PreRule& pre = rules[k];
+				std::vector<RuleStep> steps = chains[reached];
+				steps.insert(steps.end(), pre.steps.begin(), pre.steps.end());
+				const std::string* unit = pre.unitName();
+				if (!unit)
+					addRule(name, std::move(steps), pre.definition);
+				else if (!chains.count(*unit)) {
+					chains[*unit] = std::move(steps);
+					pending.push_back(*unit);
+				}
+			}
+		}
+	}
+
+	ng.grammar.startRule = g.startRule;
+	if (ng.emptyRules.count(g.startRule))
+		addRule(g.startRule, {}, {});
+	return ng;
+}
+
+ParseNode* egp::restoreParseTree(ParseNode* tree, const NormalizedGrammar& ng)
+{
+	if (!tree)
+		return nullptr;
+	std::pmr::vector<ParseNode*> nodes;
+	restoreNode(tree, ng, true, nodes);
+	return nodes.front();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "GrammarParser.h"
+#include <unordered_map>
+
+namespace egp
+{
+	// One rule of the original grammar that a normalized rule stands for
+	struct RuleStep
+	{
+		int rule;
+		std::vector<bool> kept;	// per symbol of the rule, false for a nullable one left out
+	};
+
+	struct NormalizedGrammar
+	{
+		Grammar grammar;
+		Grammar original;
+
+		// Per rule of grammar, the original rules it stands for, outermost
+		// first. Every step but the last is a unit rule whose one kept
+		// symbol is the next step; the kept symbols of the last one are the
+		// rule's definition. No steps is the empty match of the start rule.
+		std::vector<std::vector<RuleStep>> steps;
+
+		// Per nullable nonterminal, the original rule of its empty tree
+		std::unordered_map<std::string, int> emptyRules;
+	};
+
+	// Rewrites g so the parser does less work per input, without changing
+	// the language:
+	//  - Every nonterminal only matches nonempty text. A rule with nullable
+	//    symbols becomes one rule per choice of the nullable symbols left
+	//    out, so the parser never predicts or completes an empty rule. Only
+	//    the start rule keeps an empty rule, when it is nullable.
+	//  - Unit rules like Sum -> Product are collapsed: Sum gets a copy of
+	//    every rule of Product, and of the rules Product reaches through
+	//    unit rules in turn, instead of a chain of nodes per parse.
+	//
+	// The normalized grammar has no inlined rules. Parse with its grammar,
+	// then restoreParseTree gives the tree the original grammar would have
+	// given, with its rules, empty subtrees and inlined rules. Ambiguous
+	// input may resolve to another of its trees. A rule with more than
+	// MAX_NULLABLE_CHOICES optional nullable symbols is an error.
+	const int MAX_NULLABLE_CHOICES = 8;
+	NormalizedGrammar normalizeGrammar(const Grammar& g);
+
+	// Consumes tree, built from ng.grammar, and returns the same parse as a
+	// tree of ng.original
+	ParseNode* restoreParseTree(ParseNode* tree, const NormalizedGrammar& ng);
+}
@@ -1,19 +1,30 @@
 #include "GrammarParser.h"
+#include <algorithm>
 #include <cassert>
 #include "GrammarInterpreter.h"
+#include "Tracing.h"
 using namespace egp;
 
 void egp::sortEarlyVec(EarlyVec& s)
 {
+	TraceSpan span("sort");
 	int sSize = s.size();
 	for (int i = 0; i < sSize; i++) {
 		std::stable_sort(s[i].begin(), s[i].end(), egp::compareStart);
 	}
 }
 
+bool egp::isSortedEarlyVec(const EarlyVec& s)
+{
+	return std::all_of(s.begin(), s.end(), [](const EarlySet& set) {
+		return std::is_sorted(set.begin(), set.end(), egp::compareStart);
+	});
+}
+
 EarlyVec egp::invertEarlyVec(const EarlyVec& s, const Grammar& g, bool filterIncomplete)
 {
-	EarlyVec inverted;
+	TraceSpan span("invert");
+	EarlyVec inverted(s.get_allocator());
 	padEarlyVec(s.size(), inverted);
 
 	int sSize = s.size();
@@ -21,7 +32,7 @@ EarlyVec egp::invertEarlyVec(const EarlyVec& s, const Grammar& g, bool filterInc
 		int itemsSize = s[i].size();
 		for (int j = 0; j < itemsSize; j++) {
 			EarlyItem item = s[i][j];
-			Rule rule = g.rules[item.rule];
+			const Rule& rule = g.rules[item.rule];
 
 			if (filterIncomplete && rule.definition.size() > item.next)
 				continue;
@@ -48,36 +59,97 @@ void egp::padEarlyVec(int amount, EarlyVec& s)
 	}
 }
 
-ParseNode* egp::buildParseTree(const std::string& input, const EarlyVec& invertedS, const Grammar& g)
+ParseNode* egp::buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g)
 {
-	std::vector<EarlyItem> completeItems = getEdges(0, input.length(), invertedS);
-	if (!completeItems.size())
-		return nullptr;
+	return buildParseTree(input, invertedS, g, ReuseFunc());
+}
 
-	Edge<int> startingEdge = { 0, input.length(), completeItems[0].rule };
-	ParseNode* root = new ParseNode(startingEdge.data, g.rules[startingEdge.data].name);
+ParseNode* egp::buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ReuseFunc& reuse)
+{
+	return buildParseTree(input, invertedS, g, reuse, ParseLimits());
+}
 
-	// Recursive Nested Function
-	std::function<void(const Edge<int>&, ParseNode*)> buildTree;
-	buildTree = [&input, &invertedS, &g, &buildTree](const Edge<int>& edge, ParseNode* root) {
+ParseNode* egp::buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ParseLimits& limits)
+{
+	return buildParseTree(input, invertedS, g, ReuseFunc(), limits);
+}
+
+ParseNode* egp::buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ReuseFunc& reuse,
+							   const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	// Other rules can span the input too, e.g. Product in Sum -> Product,
+	// or when the start rule does not complete at all
+	for (const EarlyItem& item : getEdges(0, input.length(), invertedS)) {
+		if (g.rules[item.rule].name == g.startRule) {
+			Edge<int> startingEdge = { 0, (int)input.length(), item.rule };
+			return buildSpanTree(input, invertedS, g, startingEdge, reuse, limits, memory);
+		}
+	}
+	return nullptr;
+}
+
+ParseNode* egp::buildSpanTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const Edge<int>& edge,
+							  const ReuseFunc& reuse, const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	TraceSpan span("build tree");
+	assert(isSortedEarlyVec(invertedS));
+
+	// A node of rule, or a token of the input between start and end
+	auto newNode = [&input, &g, memory](int rule, int start, int end) -> ParseNode* {
+		Label token = Label::refer(input.substr(start, end - start));
+		if (!memory)
+			return rule == -1 ? new ParseToken(token) : new ParseNode(rule, g.rules[rule].name);
+		void* node = memory->allocate(sizeof(ParseNode), alignof(ParseNode));
+		if (rule == -1)
+			return new (node) ParseNode(-1, token, memory);
+		return new (node) ParseNode(rule, Label(g.rules[rule].name, memory), memory);
+	};
+
+	ParseNode* root = newNode(edge.data, edge.startNode, edge.endNode);
+	root->offset = edge.startNode;
+	root->length = edge.endNode - edge.startNode;
+
+	// Recursive Nested Function, start is the input offset of root
+	std::function<void(const Edge<int>&, ParseNode*, int)> buildTree;
+	buildTree = [&g, &invertedS, &input, &reuse, &limits, &newNode, &buildTree](const Edge<int>& edge, ParseNode* root, int start) {
+		checkParseLimits(limits, 0, 0, edge.startNode);
 		std::vector<Edge<int>> children = decomposeEdge(input, invertedS, g, edge);
 		for (auto it = children.begin(); it != children.end(); ++it) {
-			if (it->data == -1) {
-				root->children.push_back(new ParseToken(input.substr(it->startNode, 1)));
+			std::size_t reused = root->children.size();
+			if (it->data != -1 && reuse && reuse(*root, start, *it, root->children)) {
+				for (; reused < root->children.size(); reused++)
+					root->children[reused]->offset -= start;
+				continue;
 			}
-			else {
-				ParseNode* newNode = new ParseNode(it->data, g.rules[it->data].name);
-				root->children.push_back(newNode);
-				buildTree(*it, newNode);
+
+			if (it->data != -1 && g.rules[it->data].inlined) {
+				buildTree(*it, root, start);
+				continue;
 			}
+
+			// Attached before its subtree is built, so the tree deleted
+			// after a ParseError holds every node
+			ParseNode* node = newNode(it->data, it->startNode, it->endNode);
+			node->offset = it->startNode - start;
+			node->length = it->endNode - it->startNode;
+			root->children.push_back(node);
+			if (it->data != -1)
+				buildTree(*it, node, it->startNode);
 		}
 	};
 
-	buildTree(startingEdge, root);
+	try {
+		buildTree(edge, root, edge.startNode);
+	}
+	catch (const ParseError&) {
+		if (!memory)
+			deleteParseTree(root);
+		throw;
+	}
 	return root;
 }
 
-std::vector<Edge<int>> egp::decomposeEdge(const std::string& input, const EarlyVec& graph, const Grammar& g, const Edge<int>& edge)
+std::vector<Edge<int>> egp::decomposeEdge(std::string_view input, const EarlyVec& graph, const Grammar& g, const Edge<int>& edge)
 {
 	assert(edge.startNode < graph.size());					// assertion that start node is within the bounds of the graph
 	assert(edge.endNode < graph.size());					// assertion that end node is within the bounds of the graph
@@ -95,41 +167,76 @@ std::vector<Edge<int>> egp::decomposeEdge(const std::string& input, const EarlyV
 								// number of symbols.
 
 
-	// These nested functions are an attempt at making the depth first search
-	// function generic and also minimize the parameters these functions take 
-	auto isLeaf = [&finish, &bottom](int node, int depth) -> bool {
-		return node == finish && depth == bottom;
-	};
-
-	auto getChild = [](const Edge<int>& edge, int depth) -> int {
-		return edge.endNode;
+	// Scan edges of a terminal leaving node, longest first
+	auto terminalEdges = [&edge, &input](const Terminal* terminal, int node) -> std::vector<Edge<int>> {
+		// If we are dealing with a Terminal we
+		// don't need to iterate the graph because
+		// it is missing all Terminal/Scan edges
+		std::vector<Edge<int>> edges;
+		if (node >= edge.endNode)
+			return edges;
+
+		if (terminal->isRun()) {
+			std::size_t end = node + terminal->matchRun(input.data() + node, edge.endNode - node);
+			for (std::size_t next = node; next < end;) {
+				char32_t c;
+				next += decodeUtf8(input.data() + next, end - next, c);
+				edges.insert(edges.begin(), { node, (int)next, -1 });
+			}
+		}
+		else {
+			char32_t c;
+			std::size_t length = decodeUtf8(input.data() + node, edge.endNode - node, c);
+			if (terminal->matchText(input.substr(node, length)))
+				edges.push_back({ node, node + (int)length, -1 });
+		}
+		return edges;
 	};
 
-	auto getEdges = [&edge, &rules, &input, &graph, &g](int node, int depth) -> std::vector<Edge<int>> {
-		if (depth >= rules.size())
-			return {};
+	// Depth first search over the symbols of the rule. The inverted sets
+	// are walked in place rather than collecting every candidate edge of a
+	// node first, so the search stops at the first edge that leads to
+	// finish. The sets are sorted by sortEarlyVec, longest edges first, so
+	// the ones ending after finish are skipped with a binary search; this
+	// keeps long left recursive lists from costing quadratic time.
+	std::vector<Edge<int>> path;
+	std::function<bool(int, int)> search;
+	search = [&](int node, int depth) -> bool {
+		if (depth == bottom)
+			return node == finish;
 
-		std::vector<Edge<int>> edges;
 		Symbol* symbol = rules[depth];
-
-		// If we are dealing with a Terminal we
-		// don't need to iterate the graph because
-		// it is missing all Terminal/Scan edges
 		if (typeid(*symbol) == typeid(Terminal)) {
-			if (symbol->match(input.substr(node, 1)))
-				edges.push_back({ node, node + 1, -1});
-		}
-		else if (typeid(*symbol) == typeid(NonTerminal)) {
-			for (auto it = graph[node].begin(); it != graph[node].end(); ++it) {
-				if (symbol->match(g.rules[it->rule].name))
-					edges.push_back({ node, it->start, it->rule });
+			for (const Edge<int>& child : terminalEdges(static_cast<const Terminal*>(symbol), node)) {
+				if (search(child.endNode, depth + 1)) {
+					path.push_back(child);
+					return true;
+				}
 			}
+			return false;
 		}
 
-		return edges;
+		// start is really the end node, see getEdges()
+		const EarlySet& items = graph[node];
+		auto it = std::partition_point(items.begin(), items.end(), [finish](const EarlyItem& item) {
+			return item.start > finish;
+		});
+
+		for (; it != items.end(); ++it) {
+			if (depth + 1 == bottom && it->start != finish)
+				break;
+			if (symbol->match(g.rules[it->rule].name) && precedenceAllows(g, edge.data, depth, it->rule) &&
+				search(it->start, depth + 1)) {
+				path.push_back({ node, it->start, it->rule });
+				return true;
+			}
+		}
+		return false;
 	};
 
-	return depthFirstSearch<int>(start, getEdges, isLeaf, getChild);
+	search(start, 0);
+	std::reverse(path.begin(), path.end());
+	return path;
 }
 
 std::vector<EarlyItem> egp::getEdges(int startNode, int endNode, const EarlyVec& graph) 
@@ -148,22 +255,25 @@ std::vector<EarlyItem> egp::getEdges(int startNode, int endNode, const EarlyVec&
 
 void egp::printParseTree(ParseNode* node, bool printRule)
 {
-	std::function<void(ParseNode*, std::string indent, bool last)> recursivePrint;
-	recursivePrint = [&printRule, &recursivePrint](ParseNode* node, std::string indent, bool last) {
+	// one indent for the whole tree, each level appends to it and takes its part off again
+	std::string indent;
+	std::function<void(ParseNode*, bool last)> recursivePrint;
+	recursivePrint = [&printRule, &recursivePrint, &indent](ParseNode* node, bool last) {
 		std::cout << indent << "+- " << node->label;
 		if (printRule)
-			std::cout << " (" << node->rule << ")" << std::endl;
-		else
-			std::cout << std::endl;
+			std::cout << " (" << node->rule << ")";
+		std::cout << '\n';
 
 		indent += last ? "   " : "|  ";
 
 		for (std::size_t i = 0; i < node->children.size(); i++) {
-			recursivePrint(node->children[i], indent, i == node->children.size() - 1);
+			recursivePrint(node->children[i], i == node->children.size() - 1);
 		}
+		indent.resize(indent.length() - 3);
 	};
 
-	recursivePrint(node, "", true);
+	recursivePrint(node, true);
+	std::cout.flush();
 }
 
 void egp::deleteParseTree(ParseNode* node)
@@ -173,27 +283,62 @@ void egp::deleteParseTree(ParseNode* node)
 	delete node;
 }
 
+void egp::ownTokenLabels(ParseNode* tree)
+{
+	std::vector<ParseNode*> pending = { tree };
+	while (!pending.empty()) {
+		ParseNode* node = pending.back();
+		pending.pop_back();
+		if (node->label.refersToInput())
+			node->label = node->label.str();
+		pending.insert(pending.end(), node->children.begin(), node->children.end());
+	}
+}
+
 
 ParseNode* egp::applySemanticActions(const ParseNode* const tree, const std::vector<std::function<ParseNode*(const ParseNode&)>>& actions)
 {
+	TraceSpan span("apply actions");
 	std::function<ParseNode* (const ParseNode* const)> traverseBottomUp;
 	traverseBottomUp = [&actions, &traverseBottomUp](const ParseNode* const sourceNode) -> ParseNode* {
 		if (sourceNode->children.size() > 0) {
-			std::vector<ParseNode*> newChildren;
+			std::pmr::vector<ParseNode*> newChildren;
 			for (ParseNode* child : sourceNode->children)
 				newChildren.push_back(traverseBottomUp(child));
 
 			ParseNode tempNode = { sourceNode->rule, sourceNode->label, newChildren };
+			tempNode.offset = sourceNode->offset;
+			tempNode.length = sourceNode->length;
 			return actions[sourceNode->rule](tempNode);
 		}
-		else
-			return new ParseNode(sourceNode->rule, sourceNode->label);
+
+		ParseNode* leaf = new ParseNode(sourceNode->rule, sourceNode->label);
+		leaf->offset = sourceNode->offset;
+		leaf->length = sourceNode->length;
+		return leaf;
 
 	};
 
 	return traverseBottomUp(tree);
 }
 
+ActionVec egp::bindActions(const Grammar& g, const NamedActions& actions)
+{
+	ActionVec bound(g.rules.size(), [](const ParseNode& node) { return new ParseNode(node); });
+	for (auto& action : actions) {
+		bool found = false;
+		for (int rule = 0; rule < (int)g.rules.size(); rule++) {
+			if (g.rules[rule].name == action.first) {
+				bound[rule] = action.second;
+				found = true;
+			}
+		}
+		if (!found)
+			throw "semantic action for a rule the grammar does not have";
+	}
+	return bound;
+}
+
 /*ParseNode* egp::applySemanticActions(const ParseNode* const tree, const ActionVec& actions)
 {
 	std::function<ParseNode*(const ParseNode* const)> traverseBottomUp;
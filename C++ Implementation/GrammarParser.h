@@ -3,27 +3,63 @@
 #include "NonTerminal.h"
 #include "Terminal.h"
 #include <functional>
+#include <string_view>
 #include <initializer_list>
+#include <unordered_map>
 
 namespace egp
 {
+	// Text of a ParseNode. Tokens refer to their text in the input instead
+	// of copying it, so the input must outlive a tree built from it (or
+	// see ownTokenLabels); rule names and labels made by semantic actions
+	// are owned.
+	class Label
+	{
+	public:
+		Label() {}
+		Label(const std::string& text) : owned(text.data(), text.length()) {}
+		Label(const char* text) : owned(text) {}
+		Label(std::string_view text, std::pmr::memory_resource* memory) : owned(text, memory) {}
+		static Label refer(std::string_view text) { Label label; label.referred = text; label.isReference = true; return label; }
+
+		std::string_view view() const { return isReference ? referred : std::string_view(owned); }
+		std::string str() const { return std::string(view()); }
+		bool refersToInput() const { return isReference; }
+		std::size_t length() const { return view().length(); }
+		bool empty() const { return view().empty(); }
+		operator std::string_view() const { return view(); }
+
+		friend bool operator==(const Label& a, std::string_view b) { return a.view() == b; }
+		friend bool operator!=(const Label& a, std::string_view b) { return a.view() != b; }
+		friend std::ostream& operator<<(std::ostream& os, const Label& label) { return os << label.view(); }
+
+	private:
+		std::pmr::string owned;
+		std::string_view referred;
+		bool isReference = false;
+	};
+
 	// Graph Example: http://graphonline.ru/en/?graph=MpqftqFDbTdJGcDy
 	struct ParseNode
 	{
 		int rule = -1;
-		std::string label;
-		std::vector<ParseNode*> children;
+		Label label;
+		std::pmr::vector<ParseNode*> children;
+		std::size_t offset = 0;		// input offset of the node relative to its parent's,
+		std::size_t length = 0;		// so a subtree keeps its spans when text before it changes
 
 		ParseNode() {}
-		ParseNode(int rule, std::string label) : rule(rule), label(label) {}
-		ParseNode(int rule, std::string label, std::vector<ParseNode*> children)
-			: rule(rule), label(label), children(children) {}
+		ParseNode(int rule, Label label) : rule(rule), label(label) {}
+		ParseNode(int rule, Label label, std::pmr::vector<ParseNode*> children)
+			: rule(rule), label(label), children(std::move(children)) {}
+		ParseNode(int rule, Label label, std::pmr::memory_resource* memory)
+			: rule(rule), label(std::move(label)), children(memory) {}
 	};
 
 	struct ParseToken : public ParseNode
 	{
 		ParseToken() : ParseNode() {}
-		ParseToken(std::string label) : ParseNode(-1, label) {}
+		ParseToken(Label label) : ParseNode(-1, label) {}
 	};
 
 	template<typename T>
@@ -48,17 +84,51 @@ namespace egp
 	typedef std::function<ParseNode* (const ParseNode&)> ActionFunc;
 	typedef std::vector < ActionFunc > ActionVec;
 
+	// Semantic actions by rule name, for grammars only known at run time
+	// (see RuleVisitor otherwise). Every rule of a name gets its action and
+	// the others one that copies their node; a name no rule has is an error.
+	typedef std::unordered_map<std::string, ActionFunc> NamedActions;
+	ActionVec bindActions(const Grammar& g, const NamedActions& actions);
+
+	// Orders the sets of an inverted chart by end, longest edges first.
+	// The tree builders require it and assert isSortedEarlyVec.
 	void sortEarlyVec(EarlyVec& s);
+	bool isSortedEarlyVec(const EarlyVec& s);
+	// The inverted chart takes its memory from the same resource as s
 	EarlyVec invertEarlyVec(const EarlyVec& s, const Grammar& g, bool filterIncomplete = true);
 	void padEarlyVec(int amount, EarlyVec& s);
 	void appendEarlyItem(int set, EarlyItem& item, EarlyVec& s);
 
-	ParseNode* buildParseTree(const std::string& input, const EarlyVec& invertedS, const Grammar& g);
+	ParseNode* buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g);
+
+	// Called for every rule edge below the root before its nodes are built,
+	// with the node they go into and its input offset. Instead of building
+	// them it may append existing nodes for the edge to nodes, with offset
+	// set to their input offset, and return true: one subtree for a rule,
+	// or the children an inlined rule adds to its parent.
+	typedef std::function<bool(const ParseNode& parent, int parentStart, const Edge<int>& edge, std::pmr::vector<ParseNode*>& nodes)> ReuseFunc;
+	ParseNode* buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ReuseFunc& reuse);
+	// Throw ParseError past the deadline or when cancelled, the other
+	// limits are for the chart. Given memory, the nodes, their children
+	// and labels are all allocated from it and the tree is freed by
+	// releasing it (a monotonic_buffer_resource, say), not deleteParseTree.
+	ParseNode* buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ParseLimits& limits);
+	ParseNode* buildParseTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const ReuseFunc& reuse,
+							  const ParseLimits& limits, std::pmr::memory_resource* memory = nullptr);
+	// The tree of rule edge.data over input[edge.startNode, edge.endNode),
+	// which the chart must hold a complete item for. The root's offset is
+	// edge.startNode, its children's are relative to it as usual.
+	ParseNode* buildSpanTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const Edge<int>& edge,
+							 const ReuseFunc& reuse, const ParseLimits& limits, std::pmr::memory_resource* memory = nullptr);
 	void printParseTree(ParseNode* node, bool printRule = false);
 	void deleteParseTree(ParseNode* node);
+	// Copies the text of tokens that refer to the input into them, for a
+	// tree that has to outlive its input
+	void ownTokenLabels(ParseNode* tree);
 
 	std::vector<EarlyItem> getEdges(int startNode, int endNode, const EarlyVec& graph);
-	std::vector<Edge<int>> decomposeEdge(const std::string& input, const EarlyVec& graph, const Grammar& g, const Edge<int>& edge);
+	// graph is an inverted chart sorted by sortEarlyVec
+	std::vector<Edge<int>> decomposeEdge(std::string_view input, const EarlyVec& graph, const Grammar& g, const Edge<int>& edge);
 
 	template<typename T>
 	std::vector<Edge<T>> depthFirstSearch(int root,
@@ -1,22 +1,53 @@
 #include "GrammarRecognizer.h"
+#include "GrammarCompiler.h"
 #include "Terminal.h"
 #include "NonTerminal.h"
+#include "Tracing.h"
 #include <typeinfo>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 
 using namespace egp;
 
+namespace
+{
+	// The items and bytes of the finished sets, see chartMemoryUsage
+	struct ChartCount
+	{
+		std::size_t items = 0, bytes = 0;
+
+		void check(const EarlyVec& s, std::size_t i, const ParseLimits& limits)
+		{
+			items += s[i].size();
+			bytes += s[i].capacity() * sizeof(EarlyItem);
+			checkParseLimits(limits, items, bytes + s.capacity() * sizeof(EarlySet), i);
+		}
+	};
+}
+
 bool egp::compareStart(const EarlyItem& first, const EarlyItem& second)
 {
 	return first.start > second.start;
 }
 
-EarlyVec egp::buildItems(const Grammar& g, const std::string& input)
+std::uint64_t egp::newGrammarIdentity()
+{
+	static std::atomic<std::uint64_t> next{ 1 };
+	return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+EarlyVec egp::buildItems(const Grammar& g, std::string_view input)
+{
+	return buildItems(g, input, ParseLimits());
+}
+
+EarlyVec egp::buildItems(const Grammar& g, std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory)
 {
 	std::unordered_set<std::string> nullableRules = getNullableRules(g);
-	EarlyVec s = { {} };
+	EarlyVec s(1, memory);
 	
 	// initialize s[0] set
 	for (int i = 0; i < g.rules.size(); i++) {
@@ -26,24 +57,183 @@ EarlyVec egp::buildItems(const Grammar& g, const std::string& input)
 	}
 
 	// populate the rest of s[i]
+	TraceSpan span("recognize");
+	const Tracer* tracer = currentTracer();
+	ChartCount count;
+	for (int i = 0; i < s.size(); i++) {
+		std::uint64_t start = tracer ? traceClock() : 0;
+		processSet(s, i, 0, g, input, nullableRules);
+		traceSet(tracer, start, i, s[i].size());
+		count.check(s, i, limits);
+	}
+	span.items = count.items;
+	return s;
+}
+
+void egp::processSet(EarlyVec& s, int i, int from, const Grammar& g, std::string_view input, std::unordered_set<std::string>& nss)
+{
 	int sSize = s.size();
-	for (int i = 0; i < sSize; i++) {
-		int setSize = s[i].size();
-		for (int j = 0; j < setSize; j++) {
-			Symbol* symbol = nextSymbol(g, s[i][j]);
-			if (symbol == nullptr)
-				complete(s, i, j, setSize, g);
-			else if (typeid(*symbol) == typeid(Terminal))
-				scan(s, i, j, sSize, symbol, input);
-			else if (typeid(*symbol) == typeid(NonTerminal))
-				predict(s, i, j, setSize, symbol, g, nullableRules);
-			else
-				throw "illegal rule";
+	int setSize = s[i].size();
+	for (int j = from; j < setSize; j++) {
+		Symbol* symbol = nextSymbol(g, s[i][j]);
+		if (symbol == nullptr)
+			complete(s, i, j, setSize, g);
+		else if (typeid(*symbol) == typeid(Terminal))
+			scan(s, i, j, sSize, symbol, input);
+		else if (typeid(*symbol) == typeid(NonTerminal))
+			predict(s, i, j, setSize, symbol, g, nss);
+		else
+			throw "illegal rule";
+	}
+}
+
+EarlyVec egp::buildItems(const CompiledGrammar& g, std::string_view input)
+{
+	return buildItems(g, input, ParseLimits());
+}
+
+EarlyVec egp::buildItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	EarlyVec s(1, memory);
+
+	// initialize s[0] set with the whole prediction closure of the start rule
+	int startSymbol = g.header->startSymbol;
+	for (int k = g.predictOffsets[startSymbol]; k < g.predictOffsets[startSymbol + 1]; k++)
+		s[0].push_back({ g.predictRules[k], 0, 0 }); // EarlyItem: {rule, next, start}
+
+	TraceSpan span("recognize");
+	const Tracer* tracer = currentTracer();
+	ChartCount count;
+	for (std::size_t i = 0; i < s.size(); i++) {
+		std::uint64_t start = tracer ? traceClock() : 0;
+		processSet(s, i, 0, g, input);
+		traceSet(tracer, start, i, s[i].size());
+		count.check(s, i, limits);
+	}
+	span.items = count.items;
+	return s;
+}
+
+void egp::processSet(EarlyVec& s, std::size_t i, std::size_t from, const CompiledGrammar& g, std::string_view input)
+{
+	for (std::size_t j = from; j < s[i].size(); j++) {
+		EarlyItem item = s[i][j];
+
+		// complete
+		if (item.next >= ruleLength(g, item.rule)) {
+			std::int32_t lhs = g.ruleLhs[item.rule];
+			for (std::size_t k = 0; k < s[item.start].size(); k++) {
+				EarlyItem parent = s[item.start][k];
+				if (parent.next < ruleLength(g, parent.rule) && ruleSymbol(g, parent.rule, parent.next) == lhs &&
+					precedenceAllows(g, parent.rule, parent.next, item.rule))
+					appendItem(s[i], { parent.rule, parent.next + 1, parent.start });
+			}
+			continue;
+		}
+
+		std::int32_t symbol = ruleSymbol(g, item.rule, item.next);
+
+		// scan
+		if (symbol < 0) {
+			if (i >= input.length())
+				continue;
+
+			int terminal = decodeTerminal(symbol);
+			if (g.terminalFlags[terminal] & TERMINAL_FLAG_RUN) {
+				std::size_t length = matchTerminalRun(g, terminal, input.data() + i, input.length() - i);
+				extendRun(s, i, { item.rule, item.next + 1, item.start }, length, input);
+			}
+			else {
+				char32_t c;
+				std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+				if (matchTerminal(g, terminal, c))
+					appendScanned(s, i + length, { item.rule, item.next + 1, item.start });
+			}
+			continue;
 		}
+
+		// predict, items that sit at the start of a rule in their own set
+		// were added by a prediction closure that already includes theirs.
+		// Rules that cannot start with the next byte are left out.
+		if (item.next != 0 || (std::size_t)item.start != i) {
+			std::pair<int, int> range = predictRange(g, item.rule, item.next);
+			for (int k = range.first; k < range.second; k++) {
+				if (canPredict(g, g.predictRules[k], input, i))
+					appendItem(s[i], { g.predictRules[k], 0, (int)i });
+			}
+		}
+		if (g.nullable[symbol]) // magical completion
+			appendItem(s[i], { item.rule, item.next + 1, item.start });
 	}
+}
+
+EarlyVec egp::resumeItems(const Grammar& g, std::string_view input, EarlyVec s)
+{
+	std::unordered_set<std::string> nullableRules = getNullableRules(g);
+	std::size_t p = s.size() - 1;
+
+	reopenSet(s, p, g, input, nullableRules);
+	for (std::size_t i = p + 1; i < s.size(); i++)
+		processSet(s, i, 0, g, input, nullableRules);
 	return s;
 }
 
+EarlyVec egp::resumeItems(const CompiledGrammar& g, std::string_view input, EarlyVec s)
+{
+	std::size_t p = s.size() - 1;
+
+	reopenSet(s, p, g, input);
+	for (std::size_t i = p + 1; i < s.size(); i++)
+		processSet(s, i, 0, g, input);
+	return s;
+}
+
+void egp::reopenSet(EarlyVec& s, std::size_t p, const Grammar& g, std::string_view input, std::unordered_set<std::string>& nss)
+{
+	// Processing s[p] again only redoes its scans, every other item is
+	// already there. Runs that reached p may go on past it in this input.
+	processSet(s, p, 0, g, input, nss);
+	for (std::size_t j = 0, size = s[p].size(); j < size && p < input.length(); j++) {
+		EarlyItem item = s[p][j];
+		if (item.next == 0)
+			continue;
+
+		Symbol* previous = g.rules[item.rule].definition[item.next - 1];
+		if (typeid(*previous) == typeid(Terminal) && static_cast<const Terminal*>(previous)->isRun())
+			extendRun(s, p, item, static_cast<const Terminal*>(previous)->matchRun(input.data() + p, input.length() - p), input);
+	}
+}
+
+void egp::reopenSet(EarlyVec& s, std::size_t p, const CompiledGrammar& g, std::string_view input)
+{
+	// The rules predicted in s[p] were picked by the byte at p of the other
+	// input, drop the items of those this byte rules out before redoing the
+	// predictions. s[0] starts out with the whole closure of the start rule.
+	if (p > 0) {
+		s[p].erase(std::remove_if(s[p].begin(), s[p].end(), [&](const EarlyItem& item) {
+			return item.start == (int)p && !canPredict(g, item.rule, input, p);
+		}), s[p].end());
+	}
+	processSet(s, p, 0, g, input);
+	for (std::size_t j = 0, size = s[p].size(); j < size && p < input.length(); j++) {
+		EarlyItem item = s[p][j];
+		if (item.next == 0)
+			continue;
+
+		std::int32_t previous = ruleSymbol(g, item.rule, item.next - 1);
+		if (previous < 0 && (g.terminalFlags[decodeTerminal(previous)] & TERMINAL_FLAG_RUN))
+			extendRun(s, p, item, matchTerminalRun(g, decodeTerminal(previous), input.data() + p, input.length() - p), input);
+	}
+}
+
+void egp::extendRun(EarlyVec& s, std::size_t set, EarlyItem item, std::size_t length, std::string_view input)
+{
+	for (std::size_t next = set; next < set + length;) {
+		char32_t c;
+		next += decodeUtf8(input.data() + next, set + length - next, c);
+		appendScanned(s, next, item);
+	}
+}
 
 Symbol* egp::nextSymbol(const Grammar& g, const EarlyItem& item)
 {
@@ -57,7 +247,8 @@ void egp::complete(EarlyVec& s, int i, int j, int& size, const Grammar& g)
 	EarlyItem item = s[i][j];
 	for (int k = 0; k < s[item.start].size(); k++) {
 		Symbol* nextSym = nextSymbol(g, s[item.start][k]);
-		if (nextSym != nullptr && nextSym->match(g.rules[item.rule].name)) {
+		if (nextSym != nullptr && nextSym->match(g.rules[item.rule].name) &&
+			precedenceAllows(g, s[item.start][k].rule, s[item.start][k].next, item.rule)) {
 			// EarlyItem: {rule, next, start}
 			if (appendItem(s[i], { s[item.start][k].rule,
 							   s[item.start][k].next + 1,
@@ -67,29 +258,39 @@ void egp::complete(EarlyVec& s, int i, int j, int& size, const Grammar& g)
 	}
 }
 
-void egp::scan(EarlyVec& s, int i, int j, int& size, Symbol* symbol, const std::string& input)
+void egp::scan(EarlyVec& s, int i, int j, int& size, Symbol* symbol, std::string_view input)
 {
 	if (i >= input.length())
 		return;
 
 	EarlyItem item = s[i][j];
-	if (symbol->match(input.substr(i, 1))) {
-		if (i + 1 > s.size() - 1) {
-			s.push_back({});
-			++size;
-		}
+	const Terminal* terminal = static_cast<const Terminal*>(symbol);
 
-		// EarlyItem: {rule, next, start}
-		s[i + 1].push_back({ item.rule, 
-							 item.next + 1, 
-							 item.start }); 
+	// A run terminal completes at every code point boundary of its run
+	if (terminal->isRun()) {
+		std::size_t length = terminal->matchRun(input.data() + i, input.length() - i);
+		extendRun(s, i, { item.rule, item.next + 1, item.start }, length, input);
 	}
+	else {
+		char32_t c;
+		std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+		if (terminal->matchText(input.substr(i, length)))
+			appendScanned(s, i + length, { item.rule, item.next + 1, item.start }); // EarlyItem: {rule, next, start}
+	}
+	size = s.size();
+}
+
+void egp::appendScanned(EarlyVec& s, std::size_t set, EarlyItem item)
+{
+	if (set >= s.size())
+		s.resize(set + 1);
+	appendItem(s[set], item);
 }
 
 void egp::predict(EarlyVec& s, int i, int j, int& size, Symbol* symbol, const Grammar& g, std::unordered_set<std::string>& nss)
 {
 	for (int k = 0; k < g.rules.size(); k++) {
-		if (symbol->match(g.rules[k].name)) {
+		if (symbol->match(g.rules[k].name) && precedenceAllows(g, s[i][j].rule, s[i][j].next, k)) {
 			// EarlyItem: {rule, next, start}
 			if (appendItem(s[i], { k, 0, i }))
 				++size;
@@ -101,9 +302,9 @@ void egp::predict(EarlyVec& s, int i, int j, int& size, Symbol* symbol, const Gr
 	}
 }
 
-bool egp::appendItem(std::vector<EarlyItem>& items, EarlyItem item)
+bool egp::appendItem(EarlySet& items, EarlyItem item)
 {
-	std::vector<EarlyItem>::iterator it;
+	EarlySet::iterator it;
 	for (it = items.begin(); it != items.end(); it++) {
 		if (*it == item)
 			return false;
@@ -1,26 +1,76 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory_resource>
 #include "Symbol.h"
+#include "ParseLimits.h"
 #include <unordered_set>
 
 namespace egp 
 {
 	struct EarlyItem;
-	typedef std::vector<std::vector<EarlyItem>> EarlyVec;
+	struct CompiledGrammar;
+	// A chart takes its memory from the resource it is built with, so a
+	// request can parse into a monotonic_buffer_resource and drop it all
+	// at once. Copies of a chart go to the default resource.
+	typedef std::pmr::vector<EarlyItem> EarlySet;
+	typedef std::pmr::vector<EarlySet> EarlyVec;
+
+	enum Associativity { ASSOC_NONE, ASSOC_LEFT, ASSOC_RIGHT };
 
 	struct Rule
 	{
 		std::string name;
 		std::vector<Symbol*> definition;
+		bool inlined = false;	// helper rule, its children are spliced into the parent's node
+		int precedence = 0;		// of an operator rule, higher binds tighter; 0 for other rules
+		Associativity associativity = ASSOC_NONE;
+	};
+
+	// A number no other grammar of the process has had, for caches keyed by
+	// grammar (see ResultCache). A copy or assignment draws a new one, the
+	// copy may be changed apart from the original.
+	std::uint64_t newGrammarIdentity();
+
+	struct GrammarIdentity
+	{
+		std::uint64_t value = newGrammarIdentity();
+
+		GrammarIdentity() {}
+		GrammarIdentity(const GrammarIdentity&) {}
+		GrammarIdentity& operator=(const GrammarIdentity&) { value = newGrammarIdentity(); return *this; }
 	};
 
 	struct Grammar
 	{
 		std::string startRule;
 		std::vector<Rule> rules;
+		GrammarIdentity identity = {};
 	};
 
+	// Whether a rule of precedence child may stand for the symbol at
+	// position of an operator rule. An operand at either end has to bind
+	// tighter than the operator, or as tight on the side the operator
+	// associates to, so E -> E "+" E | E "*" E only has one parse of
+	// 1+2*3+4. Rules without precedence take and are any operand. The
+	// engines neither predict nor complete an operand this rules out.
+	inline bool precedenceAllows(int parent, Associativity associativity, int position, int length, int child)
+	{
+		if (!parent || !child || length < 2 || (position != 0 && position != length - 1))
+			return true;
+		if (child != parent)
+			return child > parent;
+		return associativity == (position == 0 ? ASSOC_LEFT : ASSOC_RIGHT);
+	}
+
+	inline bool precedenceAllows(const Grammar& g, int parent, int position, int child)
+	{
+		const Rule& rule = g.rules[parent];
+		return precedenceAllows(rule.precedence, rule.associativity, position, rule.definition.size(), g.rules[child].precedence);
+	}
+
 	struct EarlyItem
 	{
 		int rule, next, start;
@@ -32,13 +82,39 @@ namespace egp
 	};
 
 	bool compareStart(const EarlyItem& first, const EarlyItem& second);
-	EarlyVec buildItems(const Grammar& g, const std::string& input);
+	EarlyVec buildItems(const Grammar& g, std::string_view input);
+	EarlyVec buildItems(const CompiledGrammar& g, std::string_view input);
+	// Throw ParseError when the chart goes over limits, and build the
+	// chart in memory
+	EarlyVec buildItems(const Grammar& g, std::string_view input, const ParseLimits& limits,
+						std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+	EarlyVec buildItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits,
+						std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+	// Processes s[i] from item index 'from' on, so items added to a set that
+	// was already processed can be closed without redoing the others
+	void processSet(EarlyVec& s, int i, int from, const Grammar& g, std::string_view input, std::unordered_set<std::string>& nss);
+	void processSet(EarlyVec& s, std::size_t i, std::size_t from, const CompiledGrammar& g, std::string_view input);
+
+	// Continues a chart whose sets 0..p (the last ones in s) were built for
+	// another input that agrees with this one on input[0..p), where p is a
+	// code point boundary in both. Set i only depends on input[0..i), so
+	// only the scans out of s[p] are redone before the later sets are built.
+	EarlyVec resumeItems(const Grammar& g, std::string_view input, EarlyVec s);
+	EarlyVec resumeItems(const CompiledGrammar& g, std::string_view input, EarlyVec s);
+
+	// Redoes the scans out of the last set p of a chart cut there, see resumeItems
+	void reopenSet(EarlyVec& s, std::size_t p, const Grammar& g, std::string_view input, std::unordered_set<std::string>& nss);
+	void reopenSet(EarlyVec& s, std::size_t p, const CompiledGrammar& g, std::string_view input);
+
 	Symbol* nextSymbol(const Grammar& g, const EarlyItem& item);
 	void complete(EarlyVec& s, int i, int j, int& size, const Grammar& g);
-	void scan(EarlyVec& s, int i, int j, int& size, Symbol* symbol, const std::string& input);
+	void scan(EarlyVec& s, int i, int j, int& size, Symbol* symbol, std::string_view input);
 	void predict(EarlyVec& s, int i, int j, int& size, Symbol* symbol, const Grammar& g, std::unordered_set<std::string>& nss);
 
-	bool appendItem(std::vector<EarlyItem>& items, EarlyItem item);
+	bool appendItem(EarlySet& items, EarlyItem item);
+	void appendScanned(EarlyVec& s, std::size_t set, EarlyItem item);
+	// Adds item to the set after every code point of a run of length bytes
+	void extendRun(EarlyVec& s, std::size_t set, EarlyItem item, std::size_t length, std::string_view input);
 	void printEarlyVec(const EarlyVec& s, const Grammar& g, bool hideIncomplete = false);
 
 	std::unordered_set<std::string> getNullableRules(const Grammar& g);
@@ -0,0 +1,136 @@
+#include "GrammarSearch.h"
+#include "Tracing.h"
+#include <algorithm>
+
+using namespace egp;
+
+namespace
+{
+	// The recognizer loop of buildItems, with every set seeded before it
+	// is processed. Sets without items are still visited, a match can
+	// start at any of them.
+	template<typename SeedFunc, typename ProcessFunc>
+	EarlyVec searchItems(std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory,
+						 SeedFunc seed, ProcessFunc process)
+	{
+		EarlyVec s(input.length() + 1, memory);
+
+		TraceSpan span("recognize");
+		const Tracer* tracer = currentTracer();
+		std::size_t items = 0, bytes = 0;
+		for (std::size_t i = 0; i < s.size(); i++) {
+			std::uint64_t start = tracer ? traceClock() : 0;
+			seed(s[i], i);
+			process(s, i);
+			traceSet(tracer, start, i, s[i].size());
+			items += s[i].size();
+			bytes += s[i].capacity() * sizeof(EarlyItem);
+			checkParseLimits(limits, items, bytes + s.capacity() * sizeof(EarlySet), i);
+		}
+		span.items = items;
+		return s;
+	}
+
+	template<typename CompleteFunc>
+	std::vector<SearchMatch> collectMatches(const EarlyVec& s, MatchPolicy policy, CompleteFunc completesStart)
+	{
+		std::vector<SearchMatch> matches;
+		for (std::size_t i = 0; i < s.size(); i++) {
+			for (const EarlyItem& item : s[i]) {
+				if ((std::size_t)item.start != i && completesStart(item))
+					matches.push_back({ (std::size_t)item.start, i, item.rule });
+			}
+		}
+
+		// one match per span, of the first alternative that completed it
+		std::stable_sort(matches.begin(), matches.end(), [](const SearchMatch& first, const SearchMatch& second) {
+			return first.start != second.start ? first.start < second.start : first.end < second.end;
+		});
+		matches.erase(std::unique(matches.begin(), matches.end(), [](const SearchMatch& first, const SearchMatch& second) {
+			return first.start == second.start && first.end == second.end;
+		}), matches.end());
+		if (policy == MATCH_ALL)
+			return matches;
+
+		// the last match of every start is its longest
+		std::vector<SearchMatch> leftmost;
+		std::size_t end = 0;
+		for (std::size_t k = 0; k < matches.size(); k++) {
+			if (matches[k].start < end || (k + 1 < matches.size() && matches[k + 1].start == matches[k].start))
+				continue;
+			leftmost.push_back(matches[k]);
+			end = matches[k].end;
+		}
+		return leftmost;
+	}
+}
+
+EarlyVec egp::buildSearchItems(const Grammar& g, std::string_view input)
+{
+	return buildSearchItems(g, input, ParseLimits());
+}
+
+EarlyVec egp::buildSearchItems(const CompiledGrammar& g, std::string_view input)
+{
+	return buildSearchItems(g, input, ParseLimits());
+}
+
+EarlyVec egp::buildSearchItems(const Grammar& g, std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	std::unordered_set<std::string> nullableRules = getNullableRules(g);
+	std::vector<int> startRules;
+	for (int i = 0; i < (int)g.rules.size(); i++) {
+		if (g.rules[i].name == g.startRule)
+			startRules.push_back(i);
+	}
+
+	return searchItems(input, limits, memory,
+		[&startRules](EarlySet& set, std::size_t i) {
+			for (int rule : startRules)
+				appendItem(set, { rule, 0, (int)i });
+		},
+		[&g, &input, &nullableRules](EarlyVec& s, std::size_t i) {
+			processSet(s, i, 0, g, input, nullableRules);
+		});
+}
+
+EarlyVec egp::buildSearchItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	// the prediction closure of the start symbol, as buildItems seeds s[0]
+	int startSymbol = g.header->startSymbol;
+	return searchItems(input, limits, memory,
+		[&g, &input, startSymbol](EarlySet& set, std::size_t i) {
+			for (int k = g.predictOffsets[startSymbol]; k < g.predictOffsets[startSymbol + 1]; k++) {
+				if (canPredict(g, g.predictRules[k], input, i))
+					appendItem(set, { g.predictRules[k], 0, (int)i });
+			}
+		},
+		[&g, &input](EarlyVec& s, std::size_t i) {
+			processSet(s, i, 0, g, input);
+		});
+}
+
+std::vector<SearchMatch> egp::findMatches(const EarlyVec& s, const Grammar& g, MatchPolicy policy)
+{
+	std::vector<bool> startRule(g.rules.size());
+	for (int i = 0; i < (int)g.rules.size(); i++)
+		startRule[i] = g.rules[i].name == g.startRule;
+
+	return collectMatches(s, policy, [&g, &startRule](const EarlyItem& item) {
+		return startRule[item.rule] && (std::size_t)item.next == g.rules[item.rule].definition.size();
+	});
+}
+
+std::vector<SearchMatch> egp::findMatches(const EarlyVec& s, const CompiledGrammar& g, MatchPolicy policy)
+{
+	return collectMatches(s, policy, [&g](const EarlyItem& item) {
+		return g.ruleLhs[item.rule] == g.header->startSymbol && item.next == ruleLength(g, item.rule);
+	});
+}
+
+ParseNode* egp::buildMatchTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const SearchMatch& match,
+							   const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	Edge<int> edge = { (int)match.start, (int)match.end, match.rule };
+	return buildSpanTree(input, invertedS, g, edge, ReuseFunc(), limits, memory);
+}
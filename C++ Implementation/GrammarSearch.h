@@ -0,0 +1,43 @@
+#pragma once
+#include "GrammarParser.h"
+#include "GrammarCompiler.h"
+
+namespace egp
+{
+	// Searching a text for the spans the start rule matches, like grep with
+	// a grammar for a pattern. Rather than a chart per candidate substring,
+	// the search chart predicts the start rule at every position of the
+	// text as well, so one left to right pass holds the items of every
+	// match: a complete start rule item in set i that started at set j is a
+	// match of input[j, i). The compiled engine only seeds the rules that
+	// can start with the byte at the position.
+
+	struct SearchMatch
+	{
+		std::size_t start, end;
+		int rule;		// the start rule alternative that matched, for buildMatchTree
+	};
+
+	enum MatchPolicy
+	{
+		MATCH_ALL,				// every span the start rule matches
+		MATCH_LEFTMOST_LONGEST	// no overlaps, the longest match at the leftmost position first, like grep -o
+	};
+
+	EarlyVec buildSearchItems(const Grammar& g, std::string_view input);
+	EarlyVec buildSearchItems(const CompiledGrammar& g, std::string_view input);
+	EarlyVec buildSearchItems(const Grammar& g, std::string_view input, const ParseLimits& limits,
+							  std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+	EarlyVec buildSearchItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits,
+							  std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	// The matches of a search chart ordered by start, then end. Empty
+	// matches, of a start rule that can derive nothing, are left out.
+	std::vector<SearchMatch> findMatches(const EarlyVec& s, const Grammar& g, MatchPolicy policy = MATCH_ALL);
+	std::vector<SearchMatch> findMatches(const EarlyVec& s, const CompiledGrammar& g, MatchPolicy policy = MATCH_ALL);
+
+	// The tree of one match, from the search chart inverted and sorted as
+	// for buildParseTree. Only the matches asked for cost a tree.
+	ParseNode* buildMatchTree(std::string_view input, const EarlyVec& invertedS, const Grammar& g, const SearchMatch& match,
+							  const ParseLimits& limits = ParseLimits(), std::pmr::memory_resource* memory = nullptr);
+}
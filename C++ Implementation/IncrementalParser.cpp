@@ -0,0 +1,362 @@
+#include "IncrementalParser.h"
+#include "GrammarCompiler.h"
+#include <array>
+#include <cstdint>
+#include <set>
+
+using namespace egp;
+
+namespace
+{
+	bool splitsCodePoint(const std::string& text, std::size_t position)
+	{
+		return position < text.length() && (text[position] & 0xC0) == 0x80;
+	}
+
+	// Same items in newSet (set i) and oldSet (set j), where items predicted
+	// in their own set match each other and all others must have started
+	// in the unchanged sets up to p
+	bool sameItems(const EarlySet& newSet, std::size_t i, const EarlySet& oldSet, std::size_t j, std::size_t p)
+	{
+		if (newSet.size() != oldSet.size())
+			return false;
+
+		auto keys = [p](const EarlySet& set, std::size_t at, std::vector<std::array<int, 3>>& keys) {
+			for (const EarlyItem& item : set) {
+				if (item.start > (int)p && item.start != (int)at)
+					return false;
+				keys.push_back({ item.rule, item.next, item.start == (int)at ? -1 : item.start });
+			}
+			std::sort(keys.begin(), keys.end());
+			return true;
+		};
+
+		std::vector<std::array<int, 3>> newKeys, oldKeys;
+		return keys(newSet, i, newKeys) && keys(oldSet, j, oldKeys) && newKeys == oldKeys;
+	}
+
+	// Where the last node was found. The tree builder asks for the nodes
+	// from left to right, so the next one is usually its sibling.
+	struct Sibling
+	{
+		ParseNode* parent = nullptr;
+		std::size_t parentStart = 0;
+		std::size_t index = 0;
+	};
+
+	// Node of the tree with this rule and span, the next sibling of the
+	// last one or found by descending into the child that contains the span
+	ParseNode* findNode(ParseNode* root, int rule, std::size_t start, std::size_t length, Sibling& last)
+	{
+		if (last.parent && last.index + 1 < last.parent->children.size()) {
+			ParseNode* next = last.parent->children[last.index + 1];
+			if (last.parentStart + next->offset == start && next->length == length && next->rule == rule) {
+				++last.index;
+				return next;
+			}
+		}
+
+		ParseNode* node = root;
+		std::size_t nodeStart = 0;
+		while (true) {
+			if (nodeStart == start && node->length == length && node->rule == rule)
+				return node;
+
+			const std::pmr::vector<ParseNode*>& children = node->children;
+			auto it = std::upper_bound(children.begin(), children.end(), start - nodeStart, [](std::size_t offset, const ParseNode* child) {
+				return offset < child->offset;
+			});
+			while (it != children.begin() && (*(it - 1))->length == 0)
+				--it;
+			if (it == children.begin())
+				return nullptr;
+
+			ParseNode* child = *(it - 1);
+			std::size_t childStart = nodeStart + child->offset;
+			if (childStart + child->length < start + length)
+				return nullptr;
+			last = { node, nodeStart, std::size_t(it - 1 - children.begin()) };
+			node = child;
+			nodeStart = childStart;
+		}
+	}
+
+	// Tokens refer to the text, which the next edit changes
+	void ownNewTokens(ParseNode* tree, const std::unordered_set<ParseNode*>& adopted)
+	{
+		std::vector<ParseNode*> pending = { tree };
+		while (!pending.empty()) {
+			ParseNode* node = pending.back();
+			pending.pop_back();
+			if (adopted.find(node) != adopted.end())
+				continue;
+			if (node->label.refersToInput())
+				node->label = node->label.str();
+			pending.insert(pending.end(), node->children.begin(), node->children.end());
+		}
+	}
+
+	void deleteUnadopted(ParseNode* node, const std::unordered_set<ParseNode*>& adopted)
+	{
+		if (adopted.find(node) != adopted.end())
+			return;
+		for (ParseNode* child : node->children)
+			deleteUnadopted(child, adopted);
+		delete node;
+	}
+}
+
+IncrementalParser::IncrementalParser(const Grammar& g, std::string_view text, const CompiledGrammar* compiled)
+	: g(g), compiled(compiled), nullableRules(getNullableRules(g)), text(text)
+{
+	chart = { {} };
+	if (compiled) {
+		int startSymbol = compiled->header->startSymbol;
+		for (int k = compiled->predictOffsets[startSymbol]; k < compiled->predictOffsets[startSymbol + 1]; k++)
+			chart[0].push_back({ compiled->predictRules[k], 0, 0 }); // EarlyItem: {rule, next, start}
+	}
+	else {
+		for (int i = 0; i < (int)g.rules.size(); i++) {
+			if (g.rules[i].name == g.startRule)
+				chart[0].push_back({ i, 0, 0 });
+		}
+	}
+
+	for (std::size_t i = 0; i < chart.size(); i++)
+		processSet(i);
+	rebuiltSets = chart.size();
+	buildTree(0, SIZE_MAX, 0);
+}
+
+IncrementalParser::~IncrementalParser()
+{
+	if (tree)
+		deleteParseTree(tree);
+}
+
+void IncrementalParser::applyEdit(std::size_t offset, std::size_t removed, std::string_view inserted)
+{
+	if (offset > text.length() || removed > text.length() - offset)
+		throw "edit is out of range";
+
+	// Keep the sets up to a code point boundary of both texts. Before the
+	// edit they are the same bytes, so only offset itself can differ.
+	bool split = splitsCodePoint(text, offset);
+	text.replace(offset, removed, inserted);
+	split = split || splitsCodePoint(text, offset);
+
+	std::size_t p = offset;
+	while (p > 0 && ((split && p == offset) || splitsCodePoint(text, p)))
+		--p;
+	p = std::min(p, chart.size() - 1);
+
+	std::ptrdiff_t shift = std::ptrdiff_t(inserted.length()) - std::ptrdiff_t(removed);
+	std::size_t editEnd = offset + inserted.length();
+
+	EarlyVec& old = oldChart;
+	old.assign(std::make_move_iterator(chart.begin() + p + 1), std::make_move_iterator(chart.end()));
+	oldCrossed.assign(crossed.begin() + p + 1, crossed.end());
+	chart.resize(p + 1);
+	crossed.resize(p + 1);
+
+	if (compiled)
+		reopenSet(chart, p, *compiled, text);
+	else
+		reopenSet(chart, p, g, text, nullableRules);
+
+	std::size_t converged = SIZE_MAX;
+	for (std::size_t i = p + 1; i < chart.size(); i++) {
+		processSet(i);
+		if (i < editEnd || std::ptrdiff_t(i) - shift <= std::ptrdiff_t(p))
+			continue;
+
+		std::size_t j = i - shift;
+		std::size_t k = j - p - 1;
+		if (k >= old.size() || crossed[i] || oldCrossed[k] || !sameItems(chart[i], i, old[k], j, p))
+			continue;
+
+		// The rest of the old chart, with the origins after p shifted
+		converged = i;
+		chart.resize(i + 1);
+		crossed.resize(i + 1);
+		for (++k; k < old.size(); k++) {
+			for (EarlyItem& item : old[k]) {
+				if (item.start > (int)p)
+					item.start += shift;
+			}
+			chart.push_back(std::move(old[k]));
+			crossed.push_back(oldCrossed[k]);
+		}
+		break;
+	}
+
+	rebuiltSets = std::min(converged, chart.size() - 1) - p;
+	buildTree(p, converged, shift);
+}
+
+void IncrementalParser::processSet(std::size_t i)
+{
+	crossed.resize(i + 1);
+	crossed[i] = chart.size() > i + 1;
+
+	if (compiled)
+		egp::processSet(chart, i, 0, *compiled, text);
+	else
+		egp::processSet(chart, i, 0, g, text, nullableRules);
+}
+
+// The inverted chart as invertEarlyVec and sortEarlyVec would build it,
+// every set sorted by end, longest first. Only the items that end in the
+// rebuilt sets [before, after] are inverted again. Items that end before
+// them keep their place, and those that end after them are the old ones
+// with their ends, and their origins after before, shifted. The old sets
+// the rebuilt ones replaced are still in oldChart.
+void IncrementalParser::invertSets(std::size_t before, std::size_t after, std::ptrdiff_t shift)
+{
+	std::ptrdiff_t last = std::min(after, chart.size() - 1);
+	std::ptrdiff_t oldSize = inverted.size();
+	std::ptrdiff_t oldLast = after == SIZE_MAX ? oldSize - 1 : last - shift;
+	std::ptrdiff_t size = chart.size();
+
+	// The items to insert by origin: old ones that started in the replaced
+	// sets and end after them, then the rebuilt ones, walking the sets from
+	// the end as they are sorted
+	std::vector<std::pair<std::ptrdiff_t, EarlyItem>> pending;
+	for (std::ptrdiff_t j = before + 1; j <= oldLast; j++) {
+		for (const EarlyItem& item : inverted[j]) {
+			if (item.start <= oldLast)
+				break;
+			pending.push_back({ j + shift, { item.rule, item.next, int(item.start + shift) } });
+		}
+	}
+	for (std::ptrdiff_t i = last; i >= (std::ptrdiff_t)before; i--) {
+		for (const EarlyItem& item : chart[i]) {
+			if ((std::size_t)item.next >= g.rules[item.rule].definition.size())
+				pending.push_back({ item.start, { item.rule, item.next, (int)i } });
+		}
+	}
+	std::stable_sort(pending.begin(), pending.end(), [](const auto& first, const auto& second) {
+		return first.first < second.first;
+	});
+	auto next = pending.begin();
+
+	// Sets up to before replace the items that ended in the old sets, so
+	// only the origins of those items change, and of the ones that end
+	// after the convergence point
+	std::vector<std::ptrdiff_t> origins = { (std::ptrdiff_t)before };
+	auto addOrigins = [&origins, before](const EarlySet& set) {
+		for (const EarlyItem& item : set) {
+			if (item.start < (int)before)
+				origins.push_back(item.start);
+		}
+	};
+	for (std::ptrdiff_t j = before + 1; j <= oldLast; j++)
+		addOrigins(oldChart[j - before - 1]);
+	addOrigins(chart[before]);
+
+	// No scan crosses the convergence point, so an item across it has one
+	// in that set, itself or the deepest of its descendants across it. The
+	// others are found by walking up to the items that wait for them.
+	if (after != SIZE_MAX) {
+		std::vector<EarlyItem> across;
+		std::set<std::pair<int, std::string>> visited;
+		for (const EarlyItem& item : chart[last]) {
+			if (item.start <= (int)before)
+				across.push_back(item);
+		}
+		while (!across.empty()) {
+			EarlyItem item = across.back();
+			across.pop_back();
+			origins.push_back(item.start);
+			const std::string& name = g.rules[item.rule].name;
+			if (!visited.insert({ item.start, name }).second)
+				continue;
+			for (const EarlyItem& parent : chart[item.start]) {
+				const std::vector<Symbol*>& definition = g.rules[parent.rule].definition;
+				if ((std::size_t)parent.next < definition.size() && definition[parent.next]->match(name))
+					across.push_back(parent);
+			}
+		}
+	}
+	for (const auto& entry : pending) {
+		if (entry.first < (std::ptrdiff_t)before)
+			origins.push_back(entry.first);
+	}
+	std::sort(origins.begin(), origins.end());
+	origins.erase(std::unique(origins.begin(), origins.end()), origins.end());
+
+	if (size > oldSize)
+		inverted.resize(size);
+	for (std::ptrdiff_t j : origins) {
+		EarlySet& set = inverted[j];
+		auto kept = set.begin();
+		for (; kept != set.end() && kept->start > oldLast; ++kept)
+			kept->start += shift;
+		auto replaced = kept;
+		while (kept != set.end() && kept->start >= (int)before)
+			++kept;
+		auto end = next;
+		while (end != pending.end() && end->first == j)
+			++end;
+		if (replaced == kept && next == end)
+			continue;
+		auto at = set.erase(replaced, kept);
+		for (; next != end; ++next)
+			at = set.insert(at, next->second) + 1;
+	}
+
+	// The sets after the old ones move with the edit
+	if (last > oldLast)
+		std::move_backward(inverted.begin() + oldLast + 1, inverted.begin() + oldSize, inverted.begin() + size);
+	else if (last < oldLast)
+		std::move(inverted.begin() + oldLast + 1, inverted.begin() + oldSize, inverted.begin() + last + 1);
+	inverted.resize(size);
+	for (std::ptrdiff_t j = last + 1; shift != 0 && j < size; j++) {
+		for (EarlyItem& item : inverted[j])
+			item.start += shift;
+	}
+
+	for (std::ptrdiff_t j = before + 1; j <= last; j++) {
+		EarlySet& set = inverted[j];
+		set.clear();
+		for (; next != pending.end() && next->first == j; ++next)
+			set.push_back(next->second);
+	}
+}
+
+void IncrementalParser::buildTree(std::size_t before, std::size_t after, std::ptrdiff_t shift)
+{
+	invertSets(before, after, shift);
+
+	// Subtrees that end before the edit or start after the convergence
+	// point are built from the same items as before, at shifted positions
+	ParseNode* old = tree;
+	std::unordered_set<ParseNode*> adopted;
+	Sibling last;
+	auto reuse = [&](const ParseNode&, int, const Edge<int>& edge, std::pmr::vector<ParseNode*>& nodes) {
+		std::size_t start = edge.startNode, end = edge.endNode, oldStart;
+		if (old == nullptr || start == end || g.rules[edge.data].inlined)
+			return false;
+		if (end <= before)
+			oldStart = start;
+		else if (start >= after)
+			oldStart = start - shift;
+		else
+			return false;
+
+		ParseNode* node = findNode(old, edge.data, oldStart, end - start, last);
+		if (node == nullptr)
+			return false;
+		node->offset = start;
+		nodes.push_back(node);
+		adopted.insert(node);
+		return true;
+	};
+
+	tree = buildParseTree(text, inverted, g, reuse);
+	reusedNodes = adopted.size();
+	if (tree)
+		ownNewTokens(tree, adopted);
+	if (old)
+		deleteUnadopted(old, adopted);
+}
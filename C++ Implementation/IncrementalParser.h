@@ -0,0 +1,59 @@
+#pragma once
+#include "GrammarParser.h"
+#include <unordered_set>
+
+namespace egp
+{
+	// Keeps the chart and the parse tree of a text that changes by small
+	// edits, as in an editor. An edit keeps the Earley sets before it and
+	// rebuilds the sets after it only until they converge with the old
+	// chart again: from there on the old sets are reused with their origins
+	// shifted. The new tree adopts every subtree of the old one that lies
+	// before the edit or after the point of convergence.
+	//
+	// Set i converges when it holds the same items as the old set it
+	// corresponds to, all of them predicted in set i itself or started
+	// before the edit, and no scan from an earlier set reaches past it in
+	// either chart. Everything after such a set is then built from the
+	// same items and the same text as before.
+	//
+	// Recognition goes through the CompiledGrammar when one is given, which
+	// must be compiled from g. Both grammars must outlive the parser.
+	class IncrementalParser
+	{
+	public:
+		IncrementalParser(const Grammar& g, std::string_view text, const CompiledGrammar* compiled = nullptr);
+		~IncrementalParser();
+		IncrementalParser(const IncrementalParser&) = delete;
+		IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+		// Replaces removed bytes at offset by inserted
+		void applyEdit(std::size_t offset, std::size_t removed, std::string_view inserted);
+
+		const std::string& getText() const { return text; }
+		const EarlyVec& getChart() const { return chart; }
+		ParseNode* getTree() const { return tree; }	// nullptr if the text is rejected, owned by the parser
+
+		// For the last edit
+		std::size_t getRebuiltSets() const { return rebuiltSets; }
+		std::size_t getReusedNodes() const { return reusedNodes; }
+
+	private:
+		void processSet(std::size_t i);
+		void invertSets(std::size_t before, std::size_t after, std::ptrdiff_t shift);
+		void buildTree(std::size_t before, std::size_t after, std::ptrdiff_t shift);
+
+		const Grammar& g;
+		const CompiledGrammar* compiled;
+		std::unordered_set<std::string> nullableRules;
+		std::string text;
+		EarlyVec chart;
+		EarlyVec inverted;	// kept up to date with the chart by invertSets
+		std::vector<char> crossed;	// scans from earlier sets had reached past set i before it was processed
+		EarlyVec oldChart;			// the old sets after an edit, the ones it rebuilt are kept until the next
+		std::vector<char> oldCrossed;
+		ParseNode* tree = nullptr;
+		std::size_t rebuiltSets = 0;
+		std::size_t reusedNodes = 0;
+	};
+}
@@ -0,0 +1,293 @@
+#include "Lr0Automaton.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+using namespace egp;
+
+namespace
+{
+	struct Waiting
+	{
+		std::int32_t symbol;	// nonterminal the item waits for
+		std::int32_t state;		// its state after the nonterminal
+		std::int32_t origin;
+		std::int32_t from;		// its state before, for the operandGotos
+	};
+
+	bool appendAutomaton(std::vector<AutomatonItem>& items, AutomatonItem item)
+	{
+		for (const AutomatonItem& other : items) {
+			if (other.state == item.state && other.origin == item.origin)
+				return false;
+		}
+		items.push_back(item);
+		return true;
+	}
+
+	class AutomatonBuilder
+	{
+	public:
+		AutomatonBuilder(const CompiledGrammar& g, Lr0Automaton& a)
+			: g(g), a(a), lr0(a.lr0), added(lr0.rule.size(), false), rulesOf(g.header->nonTerminalCount)
+		{
+			for (int r = 0; r < g.header->ruleCount; r++)
+				rulesOf[g.ruleLhs[r]].push_back(r);
+		}
+
+		// Adds the items after every nullable nonterminal, and the rules
+		// every nonterminal predicts when predict is set
+		std::vector<std::int32_t> close(std::vector<std::int32_t> items, bool predict)
+		{
+			for (std::int32_t item : items)
+				added[item] = true;
+			for (std::size_t k = 0; k < items.size(); k++) {
+				std::int32_t symbol = lr0.postdot[items[k]];
+				if (symbol == COMPLETED || symbol < 0)
+					continue;
+				if (g.nullable[symbol])
+					add(items, items[k] + 1);
+				for (int p = g.predictOffsets[symbol]; predict && p < g.predictOffsets[symbol + 1]; p++)
+					add(items, lr0.first[g.predictRules[p]]);
+			}
+			for (std::int32_t item : items)
+				added[item] = false;
+			std::sort(items.begin(), items.end());
+			return items;
+		}
+
+		std::int32_t state(const std::vector<std::int32_t>& items)
+		{
+			auto it = ids.find(items);
+			if (it != ids.end())
+				return it->second;
+			std::int32_t id = a.states.size();
+			ids.emplace(items, id);
+			a.states.emplace_back();
+			a.states.back().items = items;
+			return id;
+		}
+
+		// Fills in the transitions of state s, which may add states
+		void expand(std::int32_t s)
+		{
+			std::vector<std::int32_t> items = a.states[s].items;
+			std::vector<std::int32_t> predicted, completes;
+			std::map<std::int32_t, std::vector<std::int32_t>> advanced;
+			TerminalBitmap first = {};
+			bool nullable = false;
+			for (std::int32_t item : items) {
+				int rule = lr0.rule[item];
+				for (int k = 0; k < 8; k++)
+					first.bits[k] |= g.ruleFirst[rule].bits[k];
+				nullable = nullable || (g.ruleFlags[rule] & RULE_FLAG_NULLABLE);
+
+				std::int32_t symbol = lr0.postdot[item];
+				if (symbol == COMPLETED) {
+					completes.push_back(rule);
+					continue;
+				}
+				advanced[symbol].push_back(item + 1);
+				if (symbol >= 0)
+					predicted.push_back(symbol);
+			}
+
+			std::vector<std::pair<std::int32_t, std::int32_t>> gotos;
+			std::vector<OperandGoto> operandGotos;
+			for (auto& next : advanced) {
+				gotos.push_back({ next.first, state(close(next.second, false)) });
+				if (next.first < 0)
+					continue;
+
+				// One rule per precedence stands for all of them
+				std::map<std::int32_t, int> operands;
+				for (int c : rulesOf[next.first])
+					operands.emplace(g.rulePrecedence[c], c);
+				for (auto& operand : operands) {
+					std::vector<std::int32_t> allowed;
+					for (std::int32_t item : next.second) {
+						int rule = lr0.rule[item];
+						if (precedenceAllows(g, rule, item - 1 - lr0.first[rule], operand.second))
+							allowed.push_back(item);
+					}
+					if (allowed.size() != next.second.size())
+						operandGotos.push_back({ next.first, operand.first, allowed.empty() ? -1 : state(close(allowed, false)) });
+				}
+			}
+
+			// A state that holds the rules it predicts already, which are
+			// the states of predictions, needs no prediction state
+			std::vector<std::int32_t> starts;
+			for (std::int32_t symbol : predicted) {
+				for (int p = g.predictOffsets[symbol]; p < g.predictOffsets[symbol + 1]; p++)
+					starts.push_back(lr0.first[g.predictRules[p]]);
+			}
+			std::sort(starts.begin(), starts.end());
+			starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+			std::int32_t prediction = -1;
+			if (!starts.empty() && !std::includes(items.begin(), items.end(), starts.begin(), starts.end()))
+				prediction = state(close(starts, true));
+
+			auto operandOf = [this](std::int32_t rule) { return std::make_pair(g.ruleLhs[rule], g.rulePrecedence[rule]); };
+			std::sort(completes.begin(), completes.end(), [&operandOf](std::int32_t x, std::int32_t y) { return operandOf(x) < operandOf(y); });
+			completes.erase(std::unique(completes.begin(), completes.end(), [&operandOf](std::int32_t x, std::int32_t y) {
+				return operandOf(x) == operandOf(y);
+			}), completes.end());
+			Lr0State& expanded = a.states[s];
+			expanded.gotos = std::move(gotos);
+			expanded.operandGotos = std::move(operandGotos);
+			expanded.completes = std::move(completes);
+			expanded.predicted = prediction;
+			expanded.first = first;
+			expanded.nullable = nullable;
+		}
+
+	private:
+		void add(std::vector<std::int32_t>& items, std::int32_t item)
+		{
+			if (!added[item]) {
+				added[item] = true;
+				items.push_back(item);
+			}
+		}
+
+		const CompiledGrammar& g;
+		Lr0Automaton& a;
+		const Lr0Items& lr0;
+		std::vector<bool> added;
+		std::vector<std::vector<int>> rulesOf;
+		std::map<std::vector<std::int32_t>, std::int32_t> ids;
+	};
+}
+
+Lr0Automaton egp::buildLr0Automaton(const CompiledGrammar& g)
+{
+	Lr0Automaton a;
+	a.lr0 = buildLr0Items(g);
+	AutomatonBuilder builder(g, a);
+
+	std::vector<std::int32_t> starts;
+	int startSymbol = g.header->startSymbol;
+	for (int r = 0; r < g.header->ruleCount; r++) {
+		if (g.ruleLhs[r] == startSymbol)
+			starts.push_back(a.lr0.first[r]);
+	}
+	a.start = builder.state(builder.close(starts, false));
+
+	// New states are appended, so this reaches all of them
+	for (std::size_t s = 0; s < a.states.size(); s++)
+		builder.expand(s);
+	return a;
+}
+
+AutomatonChart egp::buildAutomatonItems(const Lr0Automaton& a, const CompiledGrammar& g, std::string_view input)
+{
+	return buildAutomatonItems(a, g, input, ParseLimits());
+}
+
+AutomatonChart egp::buildAutomatonItems(const Lr0Automaton& a, const CompiledGrammar& g, std::string_view input,
+										const ParseLimits& limits)
+{
+	AutomatonChart s(1);
+	s[0].push_back({ a.start, 0 });
+
+	// Per finished set, the items that wait for a nonterminal, by symbol
+	std::vector<std::vector<Waiting>> waiting;
+	std::size_t items = 0, bytes = 0;
+	auto byNonTerminal = [](const Waiting& item, std::int32_t symbol) { return item.symbol < symbol; };
+
+	for (std::size_t i = 0; i < s.size(); i++) {
+		for (std::size_t j = 0; j < s[i].size(); j++) {
+			AutomatonItem item = s[i][j];
+			const Lr0State& state = a.states[item.state];
+
+			// predict
+			if (state.predicted != -1) {
+				const Lr0State& predicted = a.states[state.predicted];
+				if (predicted.nullable || (i < input.length() && predicted.first.match(input[i])))
+					appendAutomaton(s[i], { state.predicted, (std::int32_t)i });
+			}
+
+			// complete, rules completed in their own set were folded into
+			// the states as nullable
+			if (item.origin != (std::int32_t)i) {
+				const std::vector<Waiting>& parents = waiting[item.origin];
+				for (std::int32_t rule : state.completes) {
+					std::int32_t lhs = g.ruleLhs[rule];
+					auto parent = std::lower_bound(parents.begin(), parents.end(), lhs, byNonTerminal);
+					for (; parent != parents.end() && parent->symbol == lhs; ++parent) {
+						std::int32_t next = parent->state;
+						for (const OperandGoto& operand : a.states[parent->from].operandGotos) {
+							if (operand.symbol == lhs && operand.precedence == g.rulePrecedence[rule])
+								next = operand.state;
+						}
+						if (next != -1)
+							appendAutomaton(s[i], { next, parent->origin });
+					}
+				}
+			}
+
+			// scan, the terminals sort before the nonterminals
+			for (std::size_t k = 0; k < state.gotos.size() && state.gotos[k].first < 0 && i < input.length(); k++) {
+				int terminal = decodeTerminal(state.gotos[k].first);
+				AutomatonItem scanned = { state.gotos[k].second, item.origin };
+				if (g.terminalFlags[terminal] & TERMINAL_FLAG_RUN) {
+					std::size_t length = matchTerminalRun(g, terminal, input.data() + i, input.length() - i);
+					for (std::size_t next = i; next < i + length;) {
+						char32_t c;
+						next += decodeUtf8(input.data() + next, i + length - next, c);
+						if (next >= s.size())
+							s.resize(next + 1);
+						appendAutomaton(s[next], scanned);
+					}
+				}
+				else {
+					char32_t c;
+					std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+					if (matchTerminal(g, terminal, c)) {
+						if (i + length >= s.size())
+							s.resize(i + length + 1);
+						appendAutomaton(s[i + length], scanned);
+					}
+				}
+			}
+		}
+
+		// Set i is finished, index it for the completions to come
+		waiting.emplace_back();
+		for (const AutomatonItem& item : s[i]) {
+			for (const auto& next : a.states[item.state].gotos) {
+				if (next.first >= 0)
+					waiting.back().push_back({ next.first, next.second, item.origin, item.state });
+			}
+		}
+		std::stable_sort(waiting.back().begin(), waiting.back().end(), [](const Waiting& x, const Waiting& y) {
+			return x.symbol < y.symbol;
+		});
+
+		items += s[i].size();
+		bytes += s[i].capacity() * sizeof(AutomatonItem) + waiting.back().capacity() * sizeof(Waiting);
+		checkParseLimits(limits, items, bytes + s.capacity() * sizeof(s[0]), i);
+	}
+	return s;
+}
+
+EarlyVec egp::unpackAutomatonChart(const Lr0Automaton& a, const AutomatonChart& chart)
+{
+	EarlyVec s(chart.size());
+	for (std::size_t i = 0; i < chart.size(); i++) {
+		for (const AutomatonItem& item : chart[i]) {
+			for (std::int32_t lr0Item : a.states[item.state].items) {
+				int rule = a.lr0.rule[lr0Item];
+				s[i].push_back({ rule, lr0Item - a.lr0.first[rule], item.origin }); // EarlyItem: {rule, next, start}
+			}
+		}
+
+		// States with the same origin can share items
+		std::sort(s[i].begin(), s[i].end(), [](const EarlyItem& x, const EarlyItem& y) {
+			return std::tie(x.rule, x.next, x.start) < std::tie(y.rule, y.next, y.start);
+		});
+		s[i].erase(std::unique(s[i].begin(), s[i].end()), s[i].end());
+	}
+	return s;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "PackedChart.h"
+
+namespace egp
+{
+	// An Earley engine after Aycock and Horspool. The LR(0) items that
+	// always travel together are merged into the states of an LR(0)
+	// automaton built once per grammar, so a chart item is a state and an
+	// origin instead of one (rule, next, start) item per rule.
+	//
+	// Every state is closed over nullable nonterminals, so empty rules need
+	// no magical completion. The items of a state share their origin, which
+	// is why the rules a state predicts are a state of their own that
+	// starts in the current set. Like buildItems, predictions that cannot
+	// start with the next byte are left out, a state at a time. Operator
+	// precedence is kept when completing: where precedenceAllows an
+	// operator rule for only some items of a state, the state has a goto
+	// of its own for that rule's precedence. The prediction states are
+	// shared by every position, so they keep the whole closures.
+	struct OperandGoto
+	{
+		std::int32_t symbol;
+		std::int32_t precedence;	// of the completed rule
+		std::int32_t state;			// next state, or -1 when no item takes the rule
+	};
+
+	struct Lr0State
+	{
+		std::vector<std::int32_t> items;	// LR(0) items, sorted
+		std::vector<std::pair<std::int32_t, std::int32_t>> gotos;	// symbol and next state, by symbol
+		std::vector<OperandGoto> operandGotos;	// by symbol and precedence, instead of gotos
+		std::vector<std::int32_t> completes;	// rules completed here, one per nonterminal and precedence
+		std::int32_t predicted = -1;		// state of the rules predicted from this one, or -1
+
+		// For states of predictions: the bytes the rules can start with,
+		// and whether one of them is nullable, see canPredict
+		TerminalBitmap first = {};
+		bool nullable = false;
+	};
+
+	struct Lr0Automaton
+	{
+		Lr0Items lr0;
+		std::vector<Lr0State> states;
+		std::int32_t start = -1;
+	};
+
+	struct AutomatonItem
+	{
+		std::int32_t state;
+		std::int32_t origin;
+	};
+	typedef std::vector<std::vector<AutomatonItem>> AutomatonChart;
+
+	Lr0Automaton buildLr0Automaton(const CompiledGrammar& g);
+	AutomatonChart buildAutomatonItems(const Lr0Automaton& a, const CompiledGrammar& g, std::string_view input);
+	// Throw ParseError when the chart goes over limits
+	AutomatonChart buildAutomatonItems(const Lr0Automaton& a, const CompiledGrammar& g, std::string_view input,
+									   const ParseLimits& limits);
+
+	// The (rule, next, start) items of every state, for the GrammarParser
+	// functions. Those are the items of buildItems(g, input), and the
+	// predictions it leaves out for the next byte, see canPredict, or for
+	// operator precedence with the items they go on to make.
+	EarlyVec unpackAutomatonChart(const Lr0Automaton& a, const AutomatonChart& chart);
+}
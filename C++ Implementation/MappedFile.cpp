@@ -0,0 +1,181 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace egp;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+							  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw "unable to open file";
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		throw "unable to read file size";
+	}
+
+	auto newMapping = std::make_shared<Mapping>();
+	newMapping->size = static_cast<std::size_t>(fileSize.QuadPart);
+
+	if (newMapping->size) {
+		HANDLE view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (view) {
+			newMapping->data = static_cast<const char*>(MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(view);
+		}
+	}
+	CloseHandle(file);
+
+	if (newMapping->size && !newMapping->data)
+		throw "unable to map file";
+	mapping = newMapping;
+}
+
+MappedFile::Mapping::~Mapping()
+{
+	if (data)
+		UnmapViewOfFile(data);
+}
+
+SpillFile::SpillFile()
+{
+	char directory[MAX_PATH + 1], path[MAX_PATH + 1];
+	if (!GetTempPathA(sizeof(directory), directory) || !GetTempFileNameA(directory, "egp", 0, path))
+		throw "unable to create spill file";
+
+	file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+					   FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		throw "unable to create spill file";
+	}
+}
+
+SpillFile::~SpillFile()
+{
+	unmap();
+	if (file)
+		CloseHandle(file);
+}
+
+void SpillFile::map(std::size_t capacity)
+{
+	// the mapping grows the file to its size
+	LARGE_INTEGER size;
+	size.QuadPart = capacity;
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+	if (!mapping)
+		throw "unable to map spill file";
+	view = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, capacity));
+	CloseHandle(mapping);
+	if (!view)
+		throw "unable to map spill file";
+	mapped = capacity;
+}
+
+void SpillFile::unmap()
+{
+	if (view)
+		UnmapViewOfFile(view);
+	view = nullptr;
+	mapped = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw "unable to open file";
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw "unable to read file size";
+	}
+
+	auto newMapping = std::make_shared<Mapping>();
+	newMapping->size = static_cast<std::size_t>(info.st_size);
+
+	if (newMapping->size) {
+		void* view = mmap(nullptr, newMapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED)
+			newMapping->data = static_cast<const char*>(view);
+	}
+	close(fd);
+
+	if (newMapping->size && !newMapping->data)
+		throw "unable to map file";
+	mapping = newMapping;
+}
+
+MappedFile::Mapping::~Mapping()
+{
+	if (data)
+		munmap(const_cast<char*>(data), size);
+}
+
+SpillFile::SpillFile()
+{
+	const char* directory = getenv("TMPDIR");
+	std::string path = std::string(directory && *directory ? directory : "/tmp") + "/egp-spill-XXXXXX";
+	file = mkstemp(&path[0]);
+	if (file < 0)
+		throw "unable to create spill file";
+	unlink(path.c_str());
+}
+
+SpillFile::~SpillFile()
+{
+	unmap();
+	close(file);
+}
+
+void SpillFile::map(std::size_t capacity)
+{
+	if (ftruncate(file, capacity) != 0)
+		throw "unable to grow spill file";
+	void* newView = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (newView == MAP_FAILED)
+		throw "unable to map spill file";
+	view = static_cast<char*>(newView);
+	mapped = capacity;
+}
+
+void SpillFile::unmap()
+{
+	if (view)
+		munmap(view, mapped);
+	view = nullptr;
+	mapped = 0;
+}
+
+#endif
+
+void SpillFile::resize(std::size_t size)
+{
+	// Remapping keeps the contents, they are in the file
+	if (size > mapped) {
+		std::size_t capacity = std::max<std::size_t>({ size, 2 * mapped, 1 << 20 });
+		unmap();
+		map(capacity);
+	}
+	length = size;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace egp
+{
+	// Read-only view of an entire file mapped into memory. Copies share
+	// the same mapping, which is released when the last copy is destroyed.
+	// An empty file is a valid MappedFile with size() == 0.
+	class MappedFile
+	{
+	public:
+		MappedFile() {}
+		explicit MappedFile(const std::string& path);
+
+		const char* data() const { return mapping ? mapping->data : nullptr; }
+		std::size_t size() const { return mapping ? mapping->size : 0; }
+		bool isOpen() const { return mapping != nullptr; }
+
+	private:
+		struct Mapping
+		{
+			const char* data = nullptr;
+			std::size_t size = 0;
+			~Mapping();
+		};
+
+		std::shared_ptr<const Mapping> mapping;
+	};
+
+	// Writable scratch memory backed by a temporary file, which is deleted
+	// again with the SpillFile. For data larger than memory that is mostly
+	// written once: the system can write its pages back to the file and
+	// drop them instead of keeping them resident. Growing it may move
+	// data(), like a std::vector.
+	class SpillFile
+	{
+	public:
+		SpillFile();
+		~SpillFile();
+		SpillFile(const SpillFile&) = delete;
+		SpillFile& operator=(const SpillFile&) = delete;
+
+		char* data() const { return view; }
+		std::size_t size() const { return length; }
+		void resize(std::size_t size);	// keeps the contents up to the old size
+
+	private:
+		void map(std::size_t capacity);
+		void unmap();
+
+#ifdef _WIN32
+		void* file = nullptr;
+#else
+		int file = -1;
+#endif
+		char* view = nullptr;
+		std::size_t length = 0;
+		std::size_t mapped = 0;
+	};
+}
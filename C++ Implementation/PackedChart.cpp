@@ -0,0 +1,297 @@
+#include "PackedChart.h"
+#include "Tracing.h"
+#include <algorithm>
+
+using namespace egp;
+
+namespace
+{
+	bool appendPacked(std::vector<PackedItem>& items, PackedItem item)
+	{
+		for (const PackedItem& other : items) {
+			if (other.item == item.item && other.origin == item.origin)
+				return false;
+		}
+		items.push_back(item);
+		return true;
+	}
+
+	void appendAhead(std::deque<std::vector<PackedItem>>& ahead, std::size_t distance, PackedItem item)
+	{
+		if (distance >= ahead.size())
+			ahead.resize(distance + 1);
+		appendPacked(ahead[distance], item);
+	}
+
+	// See egp::processPackedSet, origins is called for every completion
+	template <typename Origins>
+	void closePackedSet(std::vector<PackedItem>& set, std::uint32_t i, std::deque<std::vector<PackedItem>>& ahead,
+					const CompiledGrammar& g, const Lr0Items& lr0, std::string_view input, const Origins& origins)
+	{
+		for (std::size_t j = 0; j < set.size(); j++) {
+			PackedItem item = set[j];
+			std::int32_t symbol = lr0.postdot[item.item];
+
+			// complete, a rule completed in its own set is empty and its parents
+			// were already advanced by the magical completion below
+			if (symbol == COMPLETED) {
+				if (item.origin == i)
+					continue;
+
+				std::int32_t lhs = g.ruleLhs[lr0.rule[item.item]];
+				auto parents = origins(item.origin);
+				const PackedItem* parent = std::lower_bound(parents.first, parents.second, lhs,
+					[&lr0](const PackedItem& other, std::int32_t symbol) { return lr0.postdot[other.item] < symbol; });
+				for (; parent != parents.second && lr0.postdot[parent->item] == lhs; ++parent) {
+					int rule = lr0.rule[parent->item];
+					if (precedenceAllows(g, rule, parent->item - lr0.first[rule], lr0.rule[item.item]))
+						appendPacked(set, { parent->item + 1, parent->origin });
+				}
+				continue;
+			}
+
+			// scan
+			if (symbol < 0) {
+				if (i >= input.length())
+					continue;
+
+				int terminal = decodeTerminal(symbol);
+				if (g.terminalFlags[terminal] & TERMINAL_FLAG_RUN) {
+					std::size_t length = matchTerminalRun(g, terminal, input.data() + i, input.length() - i);
+					for (std::size_t next = i; next < i + length;) {
+						char32_t c;
+						next += decodeUtf8(input.data() + next, i + length - next, c);
+						appendAhead(ahead, next - i - 1, { item.item + 1, item.origin });
+					}
+				}
+				else {
+					char32_t c;
+					std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+					if (matchTerminal(g, terminal, c))
+						appendAhead(ahead, length - 1, { item.item + 1, item.origin });
+				}
+				continue;
+			}
+
+			// predict, see egp::processSet
+			int rule = lr0.rule[item.item];
+			if ((std::uint32_t)lr0.first[rule] != item.item || item.origin != i) {
+				std::pair<int, int> range = predictRange(g, rule, item.item - lr0.first[rule]);
+				for (int k = range.first; k < range.second; k++) {
+					if (canPredict(g, g.predictRules[k], input, i))
+						appendPacked(set, { (std::uint32_t)lr0.first[g.predictRules[k]], i });
+				}
+			}
+			if (g.nullable[symbol]) // magical completion
+				appendPacked(set, { item.item + 1, item.origin });
+		}
+
+		std::stable_sort(set.begin(), set.end(), [&lr0](const PackedItem& a, const PackedItem& b) {
+			return lr0.postdot[a.item] < lr0.postdot[b.item];
+		});
+	}
+}
+
+Lr0Items egp::buildLr0Items(const CompiledGrammar& g)
+{
+	Lr0Items lr0;
+	for (int rule = 0; rule < g.header->ruleCount; rule++) {
+		lr0.first.push_back(lr0.rule.size());
+		int length = ruleLength(g, rule);
+		for (int next = 0; next <= length; next++) {
+			lr0.rule.push_back(rule);
+			lr0.postdot.push_back(next < length ? ruleSymbol(g, rule, next) : COMPLETED);
+		}
+	}
+	return lr0;
+}
+
+std::deque<std::vector<PackedItem>> egp::startPackedSets(const CompiledGrammar& g, const Lr0Items& lr0)
+{
+	std::deque<std::vector<PackedItem>> ahead(1);
+	int startSymbol = g.header->startSymbol;
+	for (int k = g.predictOffsets[startSymbol]; k < g.predictOffsets[startSymbol + 1]; k++)
+		ahead[0].push_back({ (std::uint32_t)lr0.first[g.predictRules[k]], 0 });
+	return ahead;
+}
+
+void egp::processPackedSet(std::vector<PackedItem>& set, std::uint32_t i, std::deque<std::vector<PackedItem>>& ahead,
+						   const CompiledGrammar& g, const Lr0Items& lr0, std::string_view input, const PackedOriginsFunc& origins)
+{
+	closePackedSet(set, i, ahead, g, lr0, input, origins);
+}
+
+std::size_t PackedChart::memoryUsage() const
+{
+	return items.capacity() * sizeof(PackedItem) + setOffsets.capacity() * sizeof(std::uint32_t);
+}
+
+PackedChart egp::buildPackedItems(const CompiledGrammar& g, std::string_view input)
+{
+	return buildPackedItems(g, input, ParseLimits());
+}
+
+PackedChart egp::buildPackedItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits, std::pmr::memory_resource* memory)
+{
+	if (input.length() >= UINT32_MAX)
+		throw "input is too long for a packed chart";
+
+	PackedChart chart = { {}, std::pmr::vector<PackedItem>(memory), std::pmr::vector<std::uint32_t>(memory) };
+	chart.lr0 = buildLr0Items(g);
+	chart.setOffsets.push_back(0);
+	const Lr0Items& lr0 = chart.lr0;
+	std::deque<std::vector<PackedItem>> ahead = startPackedSets(g, lr0);
+
+	TraceSpan span("recognize");
+	const Tracer* tracer = currentTracer();
+	for (std::uint32_t i = 0; !ahead.empty(); i++) {
+		std::uint64_t start = tracer ? traceClock() : 0;
+		std::vector<PackedItem> set = std::move(ahead.front());
+		ahead.pop_front();
+
+		closePackedSet(set, i, ahead, g, lr0, input, [&chart](std::uint32_t k) {
+			return std::make_pair(chart.begin(k), chart.end(k));
+		});
+		chart.items.insert(chart.items.end(), set.begin(), set.end());
+		chart.setOffsets.push_back(chart.items.size());
+		traceSet(tracer, start, i, set.size());
+		checkParseLimits(limits, chart.items.size(), chart.memoryUsage(), i);
+	}
+	span.items = chart.items.size();
+
+	// A memory resource of the caller's may not give the slack back
+	if (memory == std::pmr::get_default_resource()) {
+		chart.items.shrink_to_fit();
+		chart.setOffsets.shrink_to_fit();
+	}
+	return chart;
+}
+
+bool egp::recognize(const CompiledGrammar& g, std::string_view input, RecognitionStats* stats)
+{
+	if (input.length() >= UINT32_MAX)
+		throw "input is too long for a packed chart";
+
+	Lr0Items lr0 = buildLr0Items(g);
+	std::deque<std::vector<PackedItem>> ahead = startPackedSets(g, lr0);
+	RecognitionStats counted;
+	bool accepted = false;
+
+	// The finished sets that may still be needed, in input order and with
+	// only their items waiting for a nonterminal, nothing else is read again
+	std::vector<PackedItem> items;
+	std::vector<std::uint32_t> setIndex, setOffsets = { 0 };
+	auto find = [&setIndex](std::uint32_t k) {
+		std::size_t n = std::lower_bound(setIndex.begin(), setIndex.end(), k) - setIndex.begin();
+		return n < setIndex.size() && setIndex[n] == k ? n : SIZE_MAX;
+	};
+	auto origins = [&](std::uint32_t k) {
+		std::size_t n = find(k);
+		if (n == SIZE_MAX)
+			return std::make_pair(items.data(), items.data());
+		return std::make_pair(items.data() + setOffsets[n], items.data() + setOffsets[n + 1]);
+	};
+
+	// Marks the sets the items ahead start in, then going backwards the
+	// sets the items of marked sets start in, and drops the others
+	auto collect = [&]() {
+		std::vector<bool> live(setIndex.size());
+		auto mark = [&](std::uint32_t origin) {
+			std::size_t n = find(origin);
+			if (n != SIZE_MAX)
+				live[n] = true;
+		};
+		for (const std::vector<PackedItem>& set : ahead) {
+			for (const PackedItem& item : set)
+				mark(item.origin);
+		}
+		for (std::size_t n = setIndex.size(); n-- > 0;) {
+			for (std::uint32_t k = setOffsets[n]; live[n] && k < setOffsets[n + 1]; k++)
+				mark(items[k].origin);
+		}
+
+		std::size_t kept = 0, to = 0;
+		for (std::size_t n = 0; n < setIndex.size(); n++) {
+			std::uint32_t from = setOffsets[n], until = setOffsets[n + 1];
+			if (!live[n])
+				continue;
+			std::copy(items.begin() + from, items.begin() + until, items.begin() + to);
+			setIndex[kept] = setIndex[n];
+			setOffsets[kept++] = to;
+			to += until - from;
+		}
+		setOffsets[kept] = to;
+		items.resize(to);
+		setIndex.resize(kept);
+		setOffsets.resize(kept + 1);
+		if (items.capacity() > 2 * items.size()) {
+			items.shrink_to_fit();
+			setIndex.shrink_to_fit();
+			setOffsets.shrink_to_fit();
+		}
+		counted.collections++;
+	};
+
+	std::size_t collectAt = 4096;
+	for (std::uint32_t i = 0; !ahead.empty(); i++) {
+		std::vector<PackedItem> set = std::move(ahead.front());
+		ahead.pop_front();
+		closePackedSet(set, i, ahead, g, lr0, input, origins);
+
+		if (i == input.length()) {
+			for (const PackedItem& item : set) {
+				if (item.origin == 0 && lr0.postdot[item.item] == COMPLETED && g.ruleLhs[lr0.rule[item.item]] == g.header->startSymbol)
+					accepted = true;
+			}
+		}
+
+		std::size_t memory = (items.capacity() + set.capacity()) * sizeof(PackedItem)
+			+ (setIndex.capacity() + setOffsets.capacity()) * sizeof(std::uint32_t);
+		for (const std::vector<PackedItem>& later : ahead)
+			memory += later.capacity() * sizeof(PackedItem);
+		counted.peakMemory = std::max(counted.peakMemory, memory);
+
+		auto waiting = std::partition_point(set.begin(), set.end(), [&lr0](const PackedItem& item) {
+			return lr0.postdot[item.item] < 0;
+		});
+		auto completed = std::partition_point(waiting, set.end(), [&lr0](const PackedItem& item) {
+			return lr0.postdot[item.item] != COMPLETED;
+		});
+		if (waiting != completed) {
+			items.insert(items.end(), waiting, completed);
+			setIndex.push_back(i);
+			setOffsets.push_back(items.size());
+			counted.peakSets = std::max(counted.peakSets, setIndex.size());
+		}
+
+		if (items.size() >= collectAt) {
+			collect();
+			collectAt = std::max<std::size_t>(2 * items.size(), 4096);
+		}
+	}
+
+	if (stats)
+		*stats = counted;
+	return accepted;
+}
+
+EarlyVec egp::unpackChart(const PackedChart& chart)
+{
+	EarlyVec s(chart.size());
+	for (std::size_t i = 0; i < chart.size(); i++) {
+		s[i].reserve(chart.end(i) - chart.begin(i));
+		for (const PackedItem* item = chart.begin(i); item != chart.end(i); ++item) {
+			int rule = chart.lr0.rule[item->item];
+			s[i].push_back({ rule, (int)item->item - chart.lr0.first[rule], (int)item->origin }); // EarlyItem: {rule, next, start}
+		}
+	}
+	return s;
+}
+
+std::size_t egp::chartMemoryUsage(const EarlyVec& s)
+{
+	std::size_t bytes = s.capacity() * sizeof(EarlySet);
+	for (const EarlySet& set : s)
+		bytes += set.capacity() * sizeof(EarlyItem);
+	return bytes;
+}
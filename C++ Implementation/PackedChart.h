@@ -0,0 +1,82 @@
+#pragma once
+#include "GrammarCompiler.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace egp
+{
+	// A chart for large inputs. An EarlyItem is three ints and every set is
+	// its own vector; a PackedItem is the (rule, next) pair numbered as one
+	// LR(0) item plus the origin, both 32 bit, and all sets are stored back
+	// to back in one array with an offset per set. That is less than half
+	// the memory of an EarlyVec and the recognizer walks contiguous items.
+	//
+	// Within a finished set the items are grouped by the symbol after their
+	// dot, so completing a rule only visits the items of its origin set that
+	// wait for its nonterminal instead of the whole set.
+	struct PackedItem
+	{
+		std::uint32_t item;		// LR(0) item, see Lr0Items
+		std::uint32_t origin;	// set the item started in
+	};
+
+	// Item i of rule r, with the dot before symbol i, is first[r] + i; the
+	// dot after the last symbol is an item too
+	struct Lr0Items
+	{
+		std::vector<std::int32_t> first;	// per rule
+		std::vector<std::int32_t> rule;		// per item
+		std::vector<std::int32_t> postdot;	// per item, symbol after the dot or COMPLETED
+	};
+	const std::int32_t COMPLETED = INT32_MAX;
+
+	Lr0Items buildLr0Items(const CompiledGrammar& g);
+
+	struct PackedChart
+	{
+		Lr0Items lr0;
+		std::pmr::vector<PackedItem> items;
+		std::pmr::vector<std::uint32_t> setOffsets;	// set i is items[setOffsets[i]..setOffsets[i + 1])
+
+		std::size_t size() const { return setOffsets.size() - 1; }
+		const PackedItem* begin(std::size_t set) const { return items.data() + setOffsets[set]; }
+		const PackedItem* end(std::size_t set) const { return items.data() + setOffsets[set + 1]; }
+		std::size_t memoryUsage() const;	// bytes of the sets, without the LR(0) tables
+	};
+
+	// The steps of buildPackedItems, for recognizers that keep the sets
+	// their own way. ahead holds the sets after the last one processed,
+	// ahead[0] is the next one; scans only reach as far as the longest run,
+	// so it stays short. processPackedSet closes set i, which was taken off
+	// the front of ahead, scanning into the sets ahead, and groups it by
+	// postdot symbol. origins(k) gives the items of the finished set k.
+	typedef std::function<std::pair<const PackedItem*, const PackedItem*>(std::uint32_t set)> PackedOriginsFunc;
+	std::deque<std::vector<PackedItem>> startPackedSets(const CompiledGrammar& g, const Lr0Items& lr0);
+	void processPackedSet(std::vector<PackedItem>& set, std::uint32_t i, std::deque<std::vector<PackedItem>>& ahead,
+						  const CompiledGrammar& g, const Lr0Items& lr0, std::string_view input, const PackedOriginsFunc& origins);
+
+	// Same sets as buildItems(g, input), possibly in another order
+	PackedChart buildPackedItems(const CompiledGrammar& g, std::string_view input);
+	PackedChart buildPackedItems(const CompiledGrammar& g, std::string_view input, const ParseLimits& limits,
+								 std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+	struct RecognitionStats
+	{
+		std::size_t peakMemory = 0;		// bytes of sets held at once
+		std::size_t peakSets = 0;
+		std::size_t collections = 0;
+	};
+
+	// Only tells whether g accepts input, without keeping the chart. A set
+	// is needed later only while an item in the sets still ahead started
+	// in it, or in a set it is needed by through completion, so the sets
+	// no such item points back to are dropped from time to time and the
+	// others compacted. Memory then follows the nesting of the input
+	// instead of its length.
+	bool recognize(const CompiledGrammar& g, std::string_view input, RecognitionStats* stats = nullptr);
+
+	// For the GrammarParser functions
+	EarlyVec unpackChart(const PackedChart& chart);
+	std::size_t chartMemoryUsage(const EarlyVec& s);
+}
@@ -0,0 +1,35 @@
+#include "ParseLimits.h"
+#include <string>
+
+using namespace egp;
+
+namespace
+{
+	const char* describe(ParseErrorKind kind)
+	{
+		switch (kind) {
+		case PARSE_ITEM_LIMIT: return "parse exceeded its item limit";
+		case PARSE_CHART_LIMIT: return "parse exceeded its chart memory limit";
+		case PARSE_DEADLINE: return "parse passed its deadline";
+		default: return "parse was cancelled";
+		}
+	}
+}
+
+ParseError::ParseError(ParseErrorKind kind, std::size_t position)
+	: std::runtime_error(std::string(describe(kind)) + " at offset " + std::to_string(position)),
+	  kind(kind), position(position)
+{
+}
+
+void egp::checkParseLimits(const ParseLimits& limits, std::size_t items, std::size_t chartBytes, std::size_t position)
+{
+	if (limits.cancelled && limits.cancelled->load(std::memory_order_relaxed))
+		throw ParseError(PARSE_CANCELLED, position);
+	if (limits.maxItems && items > limits.maxItems)
+		throw ParseError(PARSE_ITEM_LIMIT, position);
+	if (limits.maxChartBytes && chartBytes > limits.maxChartBytes)
+		throw ParseError(PARSE_CHART_LIMIT, position);
+	if (limits.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > limits.deadline)
+		throw ParseError(PARSE_DEADLINE, position);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+
+namespace egp
+{
+	// Bounds on the work of one parse, so a pathological input cannot keep
+	// a thread or its memory for long. A limit of 0 is no limit. The
+	// recognizers check them after every set, so a parse goes at most one
+	// set over a limit, and the tree builder at every node.
+	struct ParseLimits
+	{
+		std::size_t maxItems = 0;
+		std::size_t maxChartBytes = 0;	// as counted by chartMemoryUsage
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		const std::atomic<bool>* cancelled = nullptr;	// set from any thread to stop the parse
+	};
+
+	enum ParseErrorKind { PARSE_ITEM_LIMIT, PARSE_CHART_LIMIT, PARSE_DEADLINE, PARSE_CANCELLED };
+
+	// Thrown by the functions that take ParseLimits when one is reached
+	struct ParseError : public std::runtime_error
+	{
+		ParseErrorKind kind;
+		std::size_t position;	// input offset the parse had reached
+
+		ParseError(ParseErrorKind kind, std::size_t position);
+	};
+
+	// Throws ParseError when a parse at position, with items items in
+	// chartBytes so far, is over limits
+	void checkParseLimits(const ParseLimits& limits, std::size_t items, std::size_t chartBytes, std::size_t position);
+}
@@ -0,0 +1,130 @@
+#include "ParseTreeImage.h"
+#include "MappedFile.h"
+#include <unordered_map>
+#include <fstream>
+#include <cstring>
+
+using namespace egp;
+
+ParseTreeImage egp::encodeParseTree(const ParseNode* tree, std::string_view input)
+{
+	std::vector<ParseTreeRecord> nodes;
+	std::vector<std::uint32_t> labelOffsets = { 0 };
+	std::string labels;
+	std::unordered_map<std::string, std::int32_t> labelIds;
+
+	// Preorder without recursion, trees of long lists are deep
+	struct Pending { const ParseNode* node; std::size_t start; std::size_t record; std::size_t next; };
+	std::vector<Pending> stack;
+	auto enter = [&](const ParseNode* node, std::size_t start) {
+		if (start + node->length > UINT32_MAX || nodes.size() == UINT32_MAX)
+			throw "parse tree is too large for an image";
+
+		ParseTreeRecord record = { node->rule, SPAN_LABEL, (std::uint32_t)node->children.size(), 0, (std::uint32_t)start, (std::uint32_t)node->length };
+		if (node->rule != -1 || start + node->length > input.length() || input.compare(start, node->length, node->label.view()) != 0) {
+			auto it = labelIds.find(node->label.str());
+			if (it == labelIds.end()) {
+				it = labelIds.emplace(node->label.str(), labelIds.size()).first;
+				labels += node->label.view();
+				labelOffsets.push_back(labels.size());
+			}
+			record.label = it->second;
+		}
+		stack.push_back({ node, start, nodes.size(), 0 });
+		nodes.push_back(record);
+	};
+
+	if (tree)
+		enter(tree, tree->offset);
+	while (!stack.empty()) {
+		Pending& top = stack.back();
+		if (top.next == top.node->children.size()) {
+			nodes[top.record].subtreeSize = nodes.size() - top.record;
+			stack.pop_back();
+			continue;
+		}
+		const ParseNode* child = top.node->children[top.next++];
+		enter(child, top.start + child->offset);
+	}
+
+	// Lay out the image like a compiled grammar: header, then each part
+	// aligned to 8 bytes
+	auto image = std::make_shared<std::vector<char>>(sizeof(ParseTreeHeader));
+	ParseTreeHeader header = {};
+	header.magic = PARSE_TREE_MAGIC;
+	header.version = PARSE_TREE_VERSION;
+	header.nodeCount = nodes.size();
+	header.labelCount = labelOffsets.size() - 1;
+
+	auto addPart = [&image](std::uint32_t& offset, const void* data, std::size_t bytes) {
+		image->resize((image->size() + 7) & ~std::size_t(7));
+		if (image->size() + bytes > UINT32_MAX)
+			throw "parse tree is too large for an image";
+		offset = image->size();
+		image->insert(image->end(), static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+	};
+
+	addPart(header.nodesOffset, nodes.data(), nodes.size() * sizeof(ParseTreeRecord));
+	addPart(header.labelOffsetsOffset, labelOffsets.data(), labelOffsets.size() * sizeof(std::uint32_t));
+	addPart(header.labelsOffset, labels.data(), labels.size());
+
+	header.imageSize = image->size();
+	std::memcpy(image->data(), &header, sizeof(header));
+	return bindParseTree(image->data(), image->size(), image);
+}
+
+ParseTreeImage egp::bindParseTree(const char* image, std::size_t size, std::shared_ptr<const void> storage)
+{
+	if (size < sizeof(ParseTreeHeader) || reinterpret_cast<std::uintptr_t>(image) % 8)
+		throw "invalid parse tree image";
+
+	const ParseTreeHeader* header = reinterpret_cast<const ParseTreeHeader*>(image);
+	if (header->magic != PARSE_TREE_MAGIC)
+		throw "invalid parse tree image";
+	if (header->version != PARSE_TREE_VERSION)
+		throw "unsupported parse tree image version";
+
+	std::size_t nodesEnd = header->nodesOffset + std::size_t(header->nodeCount) * sizeof(ParseTreeRecord);
+	std::size_t offsetsEnd = header->labelOffsetsOffset + (std::size_t(header->labelCount) + 1) * sizeof(std::uint32_t);
+	if (header->imageSize > size || header->nodesOffset % 8 || header->labelOffsetsOffset % 8 ||
+		nodesEnd > header->imageSize || offsetsEnd > header->imageSize || header->labelsOffset > header->imageSize)
+		throw "invalid parse tree image";
+
+	ParseTreeImage tree;
+	tree.header = header;
+	tree.nodes = reinterpret_cast<const ParseTreeRecord*>(image + header->nodesOffset);
+	tree.labelOffsets = reinterpret_cast<const std::uint32_t*>(image + header->labelOffsetsOffset);
+	tree.labels = image + header->labelsOffset;
+	tree.storage = storage;
+
+	// Cheap consistency checks, the records themselves are trusted
+	if (tree.labelOffsets[header->labelCount] > header->imageSize - header->labelsOffset ||
+		(header->nodeCount && tree.nodes[0].subtreeSize != header->nodeCount))
+		throw "invalid parse tree image";
+
+	return tree;
+}
+
+void egp::writeParseTree(const ParseTreeImage& image, const std::string& path)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw "unable to open file";
+	file.write(reinterpret_cast<const char*>(image.header), image.header->imageSize);
+	if (!file)
+		throw "unable to write file";
+}
+
+ParseTreeImage egp::loadParseTree(const std::string& path)
+{
+	auto file = std::make_shared<MappedFile>(path);
+	return bindParseTree(file->data(), file->size(), file);
+}
+
+std::string_view egp::nodeLabel(const ParseTreeImage& image, const ParseTreeRecord* node, std::string_view input)
+{
+	if (node->label == SPAN_LABEL)
+		return input.substr(node->start, node->length);
+	std::uint32_t first = image.labelOffsets[node->label];
+	return std::string_view(image.labels + first, image.labelOffsets[node->label + 1] - first);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "GrammarParser.h"
+#include <cstdint>
+#include <memory>
+
+namespace egp
+{
+	// A ParseTreeImage is a parse tree flattened into one contiguous binary
+	// image, for handing parse results to other processes. Nodes are stored
+	// in preorder as fixed size records with their rule, child count, size
+	// of their subtree and span in the input, so the first child of a node
+	// is the record after it and its next sibling is subtreeSize records
+	// on. Node labels are stored once each; tokens whose label is their
+	// text in the input store no label at all.
+	//
+	// Like a CompiledGrammar the image can be written to disk and loaded
+	// again with mmap, which only validates the header. The input itself is
+	// not part of the image. Images use the native byte order.
+
+	const std::uint32_t PARSE_TREE_MAGIC = 0x54504745; // "EGPT"
+	const std::uint32_t PARSE_TREE_VERSION = 1;
+	const std::int32_t SPAN_LABEL = -1;	// the label is the node's text in the input
+
+	struct ParseTreeHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t imageSize;
+		std::uint32_t nodeCount;
+		std::uint32_t labelCount;
+		std::uint32_t nodesOffset;		// ParseTreeRecord per node, in preorder
+		std::uint32_t labelOffsetsOffset;	// uint32 per label + 1, offset into the labels
+		std::uint32_t labelsOffset;		// label bytes, not terminated
+	};
+
+	struct ParseTreeRecord
+	{
+		std::int32_t rule;			// -1 for tokens
+		std::int32_t label;			// label id or SPAN_LABEL
+		std::uint32_t childCount;
+		std::uint32_t subtreeSize;	// records in the subtree, this one included
+		std::uint32_t start;		// input offset
+		std::uint32_t length;
+	};
+
+	struct ParseTreeImage
+	{
+		const ParseTreeHeader* header = nullptr;
+		const ParseTreeRecord* nodes = nullptr;
+		const std::uint32_t* labelOffsets = nullptr;
+		const char* labels = nullptr;
+
+		// Keeps the image alive, either an owned buffer or a MappedFile.
+		std::shared_ptr<const void> storage;
+
+		const ParseTreeRecord* root() const { return header->nodeCount ? nodes : nullptr; }
+	};
+
+	inline const ParseTreeRecord* firstChild(const ParseTreeRecord* node) { return node + 1; }
+	inline const ParseTreeRecord* nextSibling(const ParseTreeRecord* node) { return node + node->subtreeSize; }
+
+	// input is the text the tree was parsed from
+	ParseTreeImage encodeParseTree(const ParseNode* tree, std::string_view input);
+	void writeParseTree(const ParseTreeImage& image, const std::string& path);
+	ParseTreeImage loadParseTree(const std::string& path);
+	ParseTreeImage bindParseTree(const char* image, std::size_t size, std::shared_ptr<const void> storage);
+
+	// Label of the node, a view into the image or input, which is the text
+	// the tree was parsed from
+	std::string_view nodeLabel(const ParseTreeImage& image, const ParseTreeRecord* node, std::string_view input);
+}
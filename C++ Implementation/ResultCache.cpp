@@ -0,0 +1,33 @@
+#include "ResultCache.h"
+#include <cstring>
+
+using namespace egp;
+
+namespace
+{
+	std::uint64_t mix(std::uint64_t h)
+	{
+		h ^= h >> 32;
+		h *= 0xD6E8FEB86659FD93ull;
+		h ^= h >> 32;
+		return h;
+	}
+}
+
+std::uint64_t egp::hashInput(std::string_view input)
+{
+	const std::uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+	std::uint64_t h = input.length() * multiplier;
+	std::size_t i = 0;
+	for (; i + 8 <= input.length(); i += 8) {
+		std::uint64_t word;
+		std::memcpy(&word, input.data() + i, 8);
+		h = (h ^ mix(word)) * multiplier;
+	}
+	if (i < input.length()) {
+		std::uint64_t word = 0;
+		std::memcpy(&word, input.data() + i, input.length() - i);
+		h = (h ^ mix(word)) * multiplier;
+	}
+	return mix(h);
+}
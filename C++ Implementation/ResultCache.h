@@ -0,0 +1,187 @@
+#pragma once
+#include "GrammarCompiler.h"
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace egp
+{
+	// 64 bit hash of an input, 8 bytes at a time
+	std::uint64_t hashInput(std::string_view input);
+
+	// Remembers the results of whole parses, e.g. a ParseTreeImage or what
+	// the semantic actions made of the tree, for inputs that come again
+	// exactly. Where a ChartCache saves the sets of a shared prefix, a hit
+	// here skips the whole pipeline: it costs a hash of the input, one
+	// comparison with the remembered input and a short lock.
+	//
+	// Entries are keyed by the grammar's identity and the input. The
+	// identity of a Grammar is its own (see GrammarIdentity), so it must not
+	// change while its results are cached; copies of a CompiledGrammar
+	// share theirs. Every entry keeps a copy of its input, so besides at
+	// most capacity results the cache holds at most maxBytes of inputs and
+	// entries, not counting the results. The least recently used entries
+	// are dropped first, and an input larger than maxBytes is parsed
+	// without being remembered. The cache can be used from any number of
+	// threads.
+	// When several ask for the same input that is not there yet, one of
+	// them parses it and the others wait for its result. A parse that
+	// throws is not remembered and all of them get the exception, so
+	// parses should share their ParseLimits. A parse that finds no tree
+	// can return nullptr, which is remembered like any other result.
+	//
+	//	ResultCache<ParseTreeImage> trees(1024);
+	//	auto image = trees.get(cg, input, [&](std::string_view input) { ...; return std::make_shared<ParseTreeImage>(...); });
+	template<typename Result>
+	class ResultCache
+	{
+	public:
+		typedef std::shared_ptr<const Result> ResultPtr;
+
+		explicit ResultCache(std::size_t capacity = 1024, std::size_t maxBytes = std::size_t(64) << 20)
+			: capacity(capacity ? capacity : 1), maxBytes(maxBytes) {}
+		ResultCache(const ResultCache&) = delete;
+		ResultCache& operator=(const ResultCache&) = delete;
+
+		// The remembered result of g and input, or parse(input), which must
+		// return something convertible to ResultPtr
+		template<typename ParseFunc>
+		ResultPtr get(const Grammar& g, std::string_view input, ParseFunc&& parse)
+		{
+			return find(g.identity.value, input, parse);
+		}
+
+		template<typename ParseFunc>
+		ResultPtr get(const CompiledGrammar& g, std::string_view input, ParseFunc&& parse)
+		{
+			return find(g.identity, input, parse);
+		}
+
+		void clear()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			index.clear();
+			entries.clear();
+			usedBytes = 0;
+		}
+
+		std::size_t size() const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return entries.size();
+		}
+
+		std::size_t bytes() const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return usedBytes;
+		}
+
+		std::uint64_t hits() const { return hitCount.load(std::memory_order_relaxed); }	// waits for another thread's parse included
+		std::uint64_t misses() const { return missCount.load(std::memory_order_relaxed); }
+
+	private:
+		// The input of a key is the entry's copy once it is in the index
+		struct Key
+		{
+			std::uint64_t grammar;
+			std::uint64_t hash;
+			std::string_view input;
+
+			bool operator==(const Key& other) const
+			{
+				return grammar == other.grammar && hash == other.hash && input == other.input;
+			}
+		};
+
+		struct KeyHash
+		{
+			std::size_t operator()(const Key& key) const { return (std::size_t)(key.hash ^ key.grammar); }
+		};
+
+		struct Entry
+		{
+			std::uint64_t grammar;
+			std::uint64_t hash;
+			std::string input;
+			std::uint64_t id;		// tells a failed parse its entry from a newer one
+			std::shared_future<ResultPtr> result;
+		};
+		typedef typename std::list<Entry>::iterator EntryIt;
+
+		static std::size_t entryBytes(std::string_view input) { return sizeof(Entry) + input.length(); }
+
+		template<typename ParseFunc>
+		ResultPtr find(std::uint64_t grammar, std::string_view input, ParseFunc& parse)
+		{
+			if (entryBytes(input) > maxBytes) {
+				missCount.fetch_add(1, std::memory_order_relaxed);
+				return parse(input);
+			}
+
+			Key key = { grammar, hashInput(input), input };
+			std::promise<ResultPtr> promise;
+			std::shared_future<ResultPtr> remembered;
+			std::uint64_t id;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = index.find(key);
+				if (it != index.end()) {
+					entries.splice(entries.begin(), entries, it->second);
+					remembered = it->second->result;
+				}
+				else {
+					id = nextId++;
+					entries.push_front({ grammar, key.hash, std::string(input), id, promise.get_future().share() });
+					index.emplace(Key{ grammar, key.hash, entries.front().input }, entries.begin());
+					usedBytes += entryBytes(input);
+					while (entries.size() > capacity || usedBytes > maxBytes) {
+						const Entry& last = entries.back();
+						usedBytes -= entryBytes(last.input);
+						index.erase(Key{ last.grammar, last.hash, last.input });
+						entries.pop_back();
+					}
+				}
+			}
+
+			// Waits outside the lock when another thread still parses input
+			if (remembered.valid()) {
+				hitCount.fetch_add(1, std::memory_order_relaxed);
+				return remembered.get();
+			}
+			missCount.fetch_add(1, std::memory_order_relaxed);
+
+			try {
+				ResultPtr result = parse(input);
+				promise.set_value(result);
+				return result;
+			}
+			catch (...) {
+				promise.set_exception(std::current_exception());
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = index.find(key);
+				if (it != index.end() && it->second->id == id) {
+					EntryIt entry = it->second;
+					usedBytes -= entryBytes(entry->input);
+					index.erase(it);
+					entries.erase(entry);
+				}
+				throw;
+			}
+		}
+
+		std::size_t capacity;
+		std::size_t maxBytes;
+		std::size_t usedBytes = 0;
+		mutable std::mutex lock;
+		std::list<Entry> entries;	// most recently used first
+		std::unordered_map<Key, EntryIt, KeyHash> index;
+		std::uint64_t nextId = 0;
+		std::atomic<std::uint64_t> hitCount{ 0 };
+		std::atomic<std::uint64_t> missCount{ 0 };
+	};
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "GrammarParser.h"
+#include "GrammarCompiler.h"
+#include "Tracing.h"
+#include <array>
+#include <utility>
+
+namespace egp
+{
+	template<typename Derived>
+	struct RuleAction
+	{
+		const char* rule;
+		ParseNode* (Derived::*action)(const ParseNode&);
+	};
+
+	template<typename Derived>
+	constexpr RuleAction<Derived> on(const char* rule, ParseNode* (Derived::*action)(const ParseNode&))
+	{
+		return { rule, action };
+	}
+
+	// Semantic actions bound to rules by name. Derived lists them in
+	//
+	//	static constexpr auto actions() { return std::array{ on("Sum", &Calc::sum), ... }; }
+	//
+	// and bind() resolves the names against a grammar, once per grammar:
+	// a name the grammar has no rule for is an error, so renaming a rule
+	// cannot silently move an action to another one. Every rule of a name
+	// gets its action, which can tell the alternatives apart by node.rule
+	// or the children.
+	//
+	// apply() rebuilds a tree bottom up with the contract of
+	// applySemanticActions. The actions are template arguments in effect,
+	// so each is a direct member call the compiler can inline into the
+	// traversal rather than a std::function call per node. Nodes of rules
+	// without an action are copied. Grammars only known at run time use
+	// bindActions instead.
+	template<typename Derived>
+	class RuleVisitor
+	{
+	public:
+		void bind(const Grammar& g)
+		{
+			bindNames(g.rules.size(), [&g](int rule) { return g.rules[rule].name.c_str(); });
+		}
+
+		void bind(const CompiledGrammar& cg)
+		{
+			bindNames(cg.header->ruleCount, [&cg](int rule) { return ruleName(cg, rule); });
+		}
+
+		ParseNode* apply(const ParseNode* tree)
+		{
+			if (actionOf.empty())
+				throw "rule visitor is not bound to a grammar";
+			TraceSpan span("apply actions");
+			return visit(tree);
+		}
+
+	private:
+		template<typename NameFunc>
+		void bindNames(int ruleCount, NameFunc name)
+		{
+			constexpr auto actions = Derived::actions();
+			actionOf.assign(ruleCount, -1);
+			for (std::size_t k = 0; k < actions.size(); k++) {
+				bool found = false;
+				for (int rule = 0; rule < ruleCount; rule++) {
+					if (std::string_view(name(rule)) != actions[k].rule)
+						continue;
+					if (actionOf[rule] != -1)
+						throw "rule has two semantic actions";
+					actionOf[rule] = k;
+					found = true;
+				}
+				if (!found)
+					throw "semantic action for a rule the grammar does not have";
+			}
+		}
+
+		template<std::size_t... K>
+		ParseNode* dispatch(int action, const ParseNode& node, std::index_sequence<K...>)
+		{
+			constexpr auto actions = Derived::actions();
+			Derived& self = static_cast<Derived&>(*this);
+			ParseNode* result = nullptr;
+			(void)((action == (int)K && (result = (self.*actions[K].action)(node), true)) || ...);
+			return result;
+		}
+
+		ParseNode* visit(const ParseNode* source)
+		{
+			if (source->children.empty()) {
+				ParseNode* leaf = new ParseNode(source->rule, source->label);
+				leaf->offset = source->offset;
+				leaf->length = source->length;
+				return leaf;
+			}
+
+			ParseNode node(source->rule, source->label);
+			node.offset = source->offset;
+			node.length = source->length;
+			for (const ParseNode* child : source->children)
+				node.children.push_back(visit(child));
+
+			int action = actionOf[source->rule];
+			if (action == -1)
+				return new ParseNode(node);
+			return dispatch(action, node, std::make_index_sequence<Derived::actions().size()>());
+		}
+
+		std::vector<int> actionOf;	// per rule, index into Derived::actions() or -1
+	};
+}
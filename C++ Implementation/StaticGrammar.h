@@ -0,0 +1,235 @@
+#pragma once
+#include "GrammarRecognizer.h"
+#include "Terminal.h"
+#include "NonTerminal.h"
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+
+namespace egp
+{
+	// Static grammars are declared as a type whose members are constexpr,
+	// for grammars that are fixed at build time:
+	//
+	//	struct Arithmetic
+	//	{
+	//		enum { Sum, Product };
+	//		static constexpr const char* names[] = { "Sum", "Product" };
+	//		static constexpr int start = Sum;
+	//		static constexpr egp::StaticRule rules[] = {
+	//			{ Sum, { egp::ruleRef(Sum), egp::charSet("+-"), egp::ruleRef(Product) } },
+	//			{ Sum, { egp::ruleRef(Product) } },
+	//			{ Product, { egp::charRange('0', '9') } }
+	//		};
+	//	};
+	//
+	// The nullable set and prediction closures are computed by the compiler
+	// (staticTables<G>) and buildStaticItems<G> is instantiated once per
+	// grammar, so every table lookup in its loop is a constant. The rules
+	// keep their positions, so the charts can be used with the parser
+	// functions together with buildStaticGrammar<G>().
+
+	const int STATIC_RULE_LENGTH = 12;
+
+	struct StaticSymbol
+	{
+		int nonTerminal = -1;			// -1 for terminals
+		std::uint32_t chars[8] = {};	// bitmap of a terminal, code points below 256
+
+		constexpr bool isTerminal() const { return nonTerminal < 0; }
+		constexpr bool match(unsigned char c) const { return (chars[c >> 5] >> (c & 31)) & 1; }
+		constexpr void add(unsigned char c) { chars[c >> 5] |= std::uint32_t(1) << (c & 31); }
+	};
+
+	constexpr StaticSymbol ruleRef(int nonTerminal)
+	{
+		StaticSymbol symbol;
+		symbol.nonTerminal = nonTerminal;
+		return symbol;
+	}
+
+	constexpr StaticSymbol charSet(const char* set)
+	{
+		StaticSymbol symbol;
+		for (const char* c = set; *c; ++c)
+			symbol.add(*c);
+		return symbol;
+	}
+
+	constexpr StaticSymbol charRange(char first, char last)
+	{
+		StaticSymbol symbol;
+		for (int c = (unsigned char)first; c <= (unsigned char)last; c++)
+			symbol.add(c);
+		return symbol;
+	}
+
+	struct StaticRule
+	{
+		int lhs = 0;
+		int length = 0;
+		StaticSymbol rhs[STATIC_RULE_LENGTH] = {};
+
+		constexpr StaticRule(int lhs, std::initializer_list<StaticSymbol> definition)
+			: lhs(lhs), length(definition.size())
+		{
+			if (definition.size() > STATIC_RULE_LENGTH)
+				throw "static rule is too long";
+			int k = 0;
+			for (const StaticSymbol& symbol : definition)
+				rhs[k++] = symbol;
+		}
+	};
+
+	template<int RuleCount, int NonTerminalCount>
+	struct StaticTables
+	{
+		std::array<bool, NonTerminalCount> nullable = {};
+		std::array<std::array<int, RuleCount>, NonTerminalCount> predictRules = {};
+		std::array<int, NonTerminalCount> predictCount = {};
+	};
+
+	template<typename G>
+	constexpr int staticRuleCount() { return sizeof(G::rules) / sizeof(StaticRule); }
+
+	template<typename G>
+	constexpr int staticNonTerminalCount() { return sizeof(G::names) / sizeof(const char*); }
+
+	template<typename G>
+	constexpr StaticTables<staticRuleCount<G>(), staticNonTerminalCount<G>()> computeStaticTables()
+	{
+		constexpr int R = staticRuleCount<G>();
+		constexpr int N = staticNonTerminalCount<G>();
+		StaticTables<R, N> tables;
+
+		for (const StaticRule& rule : G::rules) {
+			if (rule.lhs < 0 || rule.lhs >= N)
+				throw "static rule has an unknown name";
+			for (int k = 0; k < rule.length; k++) {
+				if (rule.rhs[k].nonTerminal >= N)
+					throw "static rule references an unknown name";
+			}
+		}
+
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (const StaticRule& rule : G::rules) {
+				int k = 0;
+				while (k < rule.length && !rule.rhs[k].isTerminal() && tables.nullable[rule.rhs[k].nonTerminal])
+					++k;
+				if (k == rule.length && !tables.nullable[rule.lhs]) {
+					tables.nullable[rule.lhs] = true;
+					changed = true;
+				}
+			}
+		}
+
+		// Nonterminals reachable in leftmost position, see compileGrammar()
+		for (int n = 0; n < N; n++) {
+			std::array<bool, N> reached = {};
+			reached[n] = true;
+			changed = true;
+			while (changed) {
+				changed = false;
+				for (const StaticRule& rule : G::rules) {
+					if (!reached[rule.lhs])
+						continue;
+					for (int k = 0; k < rule.length && !rule.rhs[k].isTerminal(); k++) {
+						int m = rule.rhs[k].nonTerminal;
+						if (!reached[m])
+							reached[m] = changed = true;
+						if (!tables.nullable[m])
+							break;
+					}
+				}
+			}
+
+			for (int r = 0; r < R; r++) {
+				if (reached[G::rules[r].lhs])
+					tables.predictRules[n][tables.predictCount[n]++] = r;
+			}
+		}
+		return tables;
+	}
+
+	template<typename G>
+	inline constexpr auto staticTables = computeStaticTables<G>();
+
+	template<typename G>
+	EarlyVec buildStaticItems(std::string_view input)
+	{
+		constexpr const auto& tables = staticTables<G>;
+		EarlyVec s = { {} };
+
+		for (int k = 0; k < tables.predictCount[G::start]; k++)
+			s[0].push_back({ tables.predictRules[G::start][k], 0, 0 }); // EarlyItem: {rule, next, start}
+
+		for (std::size_t i = 0; i < s.size(); i++) {
+			for (std::size_t j = 0; j < s[i].size(); j++) {
+				EarlyItem item = s[i][j];
+				const StaticRule& rule = G::rules[item.rule];
+
+				// complete
+				if (item.next >= rule.length) {
+					for (std::size_t k = 0; k < s[item.start].size(); k++) {
+						EarlyItem parent = s[item.start][k];
+						const StaticRule& parentRule = G::rules[parent.rule];
+						if (parent.next < parentRule.length && parentRule.rhs[parent.next].nonTerminal == rule.lhs)
+							appendItem(s[i], { parent.rule, parent.next + 1, parent.start });
+					}
+					continue;
+				}
+
+				const StaticSymbol& symbol = rule.rhs[item.next];
+
+				// scan
+				if (symbol.isTerminal()) {
+					if (i < input.length()) {
+						char32_t c;
+						std::size_t length = decodeUtf8(input.data() + i, input.length() - i, c);
+						if (c < 256 && symbol.match(c))
+							appendScanned(s, i + length, { item.rule, item.next + 1, item.start });
+					}
+					continue;
+				}
+
+				// predict, see buildItems(const CompiledGrammar&, ...)
+				if (item.next != 0 || (std::size_t)item.start != i) {
+					for (int k = 0; k < tables.predictCount[symbol.nonTerminal]; k++)
+						appendItem(s[i], { tables.predictRules[symbol.nonTerminal][k], 0, (int)i });
+				}
+				if (tables.nullable[symbol.nonTerminal]) // magical completion
+					appendItem(s[i], { item.rule, item.next + 1, item.start });
+			}
+		}
+		return s;
+	}
+
+	// Runtime Grammar with the same rule indices, for the parser functions
+	template<typename G>
+	Grammar buildStaticGrammar()
+	{
+		Grammar g;
+		g.startRule = G::names[G::start];
+		for (const StaticRule& rule : G::rules) {
+			Rule newRule = { G::names[rule.lhs], {} };
+			for (int k = 0; k < rule.length; k++) {
+				const StaticSymbol& symbol = rule.rhs[k];
+				if (!symbol.isTerminal()) {
+					newRule.definition.push_back(new NonTerminal(G::names[symbol.nonTerminal]));
+					continue;
+				}
+
+				std::set<std::string> chars;
+				for (int c = 0; c < 256; c++) {
+					if (symbol.match(c))
+						chars.insert(encodeUtf8(c));
+				}
+				newRule.definition.push_back(new Terminal(chars));
+			}
+			g.rules.push_back(newRule);
+		}
+		return g;
+	}
+}
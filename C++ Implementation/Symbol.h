@@ -11,6 +11,7 @@ public:
 	Symbol() {};
 	Symbol(std::string symbol) { symbols.insert(symbol); };
 	Symbol(std::set<std::string> symbols) { this->symbols = symbols; };
+	virtual ~Symbol() {};
 
 	virtual bool match(const std::string& symbol) const {
 		if (symbols.find(symbol) != symbols.end())
@@ -26,7 +27,7 @@ public:
 		return true;
 	}
 
-	std::string toString() const {
+	virtual std::string toString() const {
 		if (symbols.size() > 1) {
 			std::string str = "[";
 			std::set<std::string>::iterator it;
@@ -43,6 +44,8 @@ public:
 		return *symbols.begin();
 	}
 
+	const std::set<std::string>& getSymbols() const { return symbols; }
+
 	friend std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
 		os << symbol.toString();
 		return os;
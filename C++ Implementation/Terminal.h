@@ -1,5 +1,9 @@
 #pragma once
 #include "Symbol.h"
+#include "Utf8.h"
+#include <vector>
+#include <string_view>
+#include <cstdint>
 
 class Terminal : public Symbol
 {
@@ -7,4 +11,138 @@ public:
 	Terminal(): Symbol() {};
 	Terminal(const std::string& symbol): Symbol(symbol) {};
 	Terminal(std::set<std::string> symbols): Symbol(symbols) {};
-};
\ No newline at end of file
+
+	// A character class over code points, e.g. [a-z] or [^"].
+	// Matching goes through an ASCII bitmap and a sorted range table
+	// instead of a set holding every single character.
+	// A run class matches one or more code points of the class at once,
+	// so a repetition like [a-z]+ is scanned in one step.
+	Terminal(std::vector<CharRange> ranges, bool negated = false, bool run = false)
+		: ranges(ranges), negated(negated), charClass(true), run(run)
+	{
+		std::sort(this->ranges.begin(), this->ranges.end(), [](const CharRange& a, const CharRange& b) {
+			return a.first < b.first;
+		});
+
+		std::vector<CharRange> merged;
+		for (const CharRange& range : this->ranges) {
+			if (range.first > range.last)
+				continue;
+			if (!merged.empty() && range.first <= merged.back().last + 1)
+				merged.back().last = std::max(merged.back().last, range.last);
+			else
+				merged.push_back(range);
+		}
+		this->ranges = merged;
+
+		// The ranges actually matched, complemented for negated classes
+		matched = merged;
+		if (negated) {
+			matched.clear();
+			char32_t next = 0;
+			for (const CharRange& range : merged) {
+				if (range.first > next)
+					matched.push_back({ next, range.first - 1 });
+				next = range.last + 1;
+			}
+			if (next <= 0x10FFFF)
+				matched.push_back({ next, 0x10FFFF });
+		}
+
+		for (char32_t c = 0; c < 128; c++) {
+			if (inRanges(c))
+				ascii[c >> 5] |= std::uint32_t(1) << (c & 31);
+		}
+	}
+
+	bool isClass() const { return charClass; }
+	bool isNegated() const { return negated; }
+	bool isRun() const { return run; }
+	const std::vector<CharRange>& getRanges() const { return ranges; }
+
+	// Sorted code point ranges this terminal matches, for both forms
+	std::vector<CharRange> getMatchedRanges() const {
+		if (charClass)
+			return matched;
+
+		std::vector<CharRange> codePoints;
+		for (const std::string& str : symbols) {
+			char32_t c;
+			if (!str.empty() && egp::decodeUtf8(str.data(), str.size(), c) == str.size())
+				codePoints.push_back({ c, c });
+		}
+		return Terminal(codePoints).getMatchedRanges();
+	}
+
+	bool matchCodePoint(char32_t c) const {
+		if (c < 128)
+			return (ascii[c >> 5] >> (c & 31)) & 1;
+		return inRanges(c);
+	}
+
+	// Length in bytes of the run of this class starting at text[0]
+	std::size_t matchRun(const char* text, std::size_t length) const {
+		return egp::matchRun(text, length, matched.data(), matched.size());
+	}
+
+	virtual bool match(const std::string& symbol) const override {
+		if (!charClass)
+			return Symbol::match(symbol);
+		if (symbol.empty())
+			return false;
+		if (run)
+			return matchRun(symbol.data(), symbol.size()) == symbol.size();
+
+		char32_t c;
+		if (egp::decodeUtf8(symbol.data(), symbol.size(), c) != symbol.size())
+			return false;
+		return matchCodePoint(c);
+	}
+
+	using Symbol::match;
+
+	// match() for a slice of the input, without copying it into a string
+	bool matchText(std::string_view text) const {
+		if (charClass) {
+			char32_t c;
+			if (text.empty())
+				return false;
+			if (run)
+				return matchRun(text.data(), text.size()) == text.size();
+			return egp::decodeUtf8(text.data(), text.size(), c) == text.size() && matchCodePoint(c);
+		}
+		for (const std::string& symbol : symbols) {
+			if (symbol == text)
+				return true;
+		}
+		return false;
+	}
+
+	virtual std::string toString() const override {
+		if (!charClass)
+			return Symbol::toString();
+
+		std::string str = negated ? "[^" : "[";
+		for (const CharRange& range : ranges) {
+			str += egp::encodeUtf8(range.first);
+			if (range.last != range.first)
+				str += "-" + egp::encodeUtf8(range.last);
+		}
+		return str + (run ? "]+" : "]");
+	}
+
+private:
+	bool inRanges(char32_t c) const {
+		auto it = std::upper_bound(matched.begin(), matched.end(), c, [](char32_t c, const CharRange& range) {
+			return c < range.first;
+		});
+		return it != matched.begin() && c <= (it - 1)->last;
+	}
+
+	std::vector<CharRange> ranges;
+	std::vector<CharRange> matched;
+	bool negated = false;
+	bool charClass = false;
+	bool run = false;
+	std::uint32_t ascii[4] = {};
+};
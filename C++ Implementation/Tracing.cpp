@@ -0,0 +1,144 @@
+#include "Tracing.h"
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+using namespace egp;
+
+namespace
+{
+	std::atomic<std::uint32_t> threadCount{ 0 };
+
+	std::uint32_t traceThread()
+	{
+		thread_local std::uint32_t thread = ++threadCount;
+		return thread;
+	}
+
+	void writeJsonString(std::ostream& out, const char* text)
+	{
+		out << '"';
+		for (; *text; text++) {
+			unsigned char c = *text;
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if (c < 0x20) {
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out << escaped;
+			}
+			else
+				out << c;
+		}
+		out << '"';
+	}
+
+	// Times in microseconds, as the format has them
+	void writeMicroseconds(std::ostream& out, std::uint64_t nanoseconds)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%llu.%03u", (unsigned long long)(nanoseconds / 1000), (unsigned)(nanoseconds % 1000));
+		out << text;
+	}
+
+	void writeEvent(std::ostream& out, const TraceEvent& event)
+	{
+		out << "{\"name\":";
+		writeJsonString(out, event.name);
+		out << ",\"cat\":\"egp\",\"ph\":\"X\",\"ts\":";
+		writeMicroseconds(out, event.start);
+		out << ",\"dur\":";
+		writeMicroseconds(out, event.duration);
+		out << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{\"request\":" << event.request << ",\"grammar\":";
+		writeJsonString(out, event.grammar);
+		if (event.set != -1)
+			out << ",\"set\":" << event.set;
+		out << ",\"items\":" << event.items << "}}";
+	}
+}
+
+std::uint64_t egp::traceClock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void egp::recordTrace(const Tracer& tracer, const char* name, std::uint64_t start, std::int64_t set, std::uint64_t items)
+{
+	if (!tracer.sink)
+		return;
+	TraceEvent event = { name, tracer.grammar, tracer.request, start, traceClock() - start, traceThread(), set, items };
+	tracer.sink->record(event);
+}
+
+ChromeTraceSink::ChromeTraceSink(std::ostream& out)
+	: out(out)
+{
+	out << "{\"traceEvents\":[\n";
+}
+
+ChromeTraceSink::~ChromeTraceSink()
+{
+	out << "\n]}\n";
+	out.flush();
+}
+
+void ChromeTraceSink::record(const TraceEvent& event)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (!first)
+		out << ",\n";
+	first = false;
+	writeEvent(out, event);
+}
+
+RingBufferSink::RingBufferSink(std::size_t capacity)
+	: slots(new Slot[capacity ? capacity : 1]), capacity(capacity ? capacity : 1)
+{
+}
+
+void RingBufferSink::record(const TraceEvent& event)
+{
+	static_assert(std::is_trivially_copyable<TraceEvent>::value, "events are copied as words");
+	std::uint64_t words[eventWords] = {};
+	std::memcpy(words, &event, sizeof(event));
+
+	std::uint64_t n = next.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = slots[n % capacity];
+	slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (std::size_t k = 0; k < eventWords; k++)
+		slot.event[k].store(words[k], std::memory_order_relaxed);
+	slot.sequence.store(2 * n + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> RingBufferSink::snapshot() const
+{
+	std::uint64_t end = next.load(std::memory_order_acquire);
+	std::uint64_t begin = end > capacity ? end - capacity : 0;
+	std::vector<TraceEvent> events;
+	for (std::uint64_t n = begin; n < end; n++) {
+		const Slot& slot = slots[n % capacity];
+		std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+		std::uint64_t words[eventWords];
+		for (std::size_t k = 0; k < eventWords; k++)
+			words[k] = slot.event[k].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (before == 2 * n + 2 && slot.sequence.load(std::memory_order_relaxed) == before) {
+			TraceEvent event;
+			std::memcpy(&event, words, sizeof(event));
+			events.push_back(event);
+		}
+	}
+	return events;
+}
+
+void egp::writeChromeTrace(std::ostream& out, const std::vector<TraceEvent>& events)
+{
+	out << "{\"traceEvents\":[\n";
+	for (std::size_t k = 0; k < events.size(); k++) {
+		if (k)
+			out << ",\n";
+		writeEvent(out, events[k]);
+	}
+	out << "\n]}\n";
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace egp
+{
+	// One phase of a parse, or one slow set of a recognizer. Times are
+	// nanoseconds of std::chrono::steady_clock.
+	struct TraceEvent
+	{
+		const char* name;		// "recognize", "invert", "sort", "build tree", "apply actions" or "set"
+		const char* grammar;
+		std::uint64_t request;
+		std::uint64_t start;
+		std::uint64_t duration;
+		std::uint32_t thread;	// small number per thread, in order of first event
+		std::int64_t set;		// of a "set" event, -1 otherwise
+		std::uint64_t items;	// items of the set, or of the chart a recognizer built
+	};
+
+	class TraceSink
+	{
+	public:
+		virtual ~TraceSink() {}
+		// Called from every thread that parses, with no lock held
+		virtual void record(const TraceEvent& event) = 0;
+	};
+
+	// What the parse functions on this thread report to, see TraceScope.
+	// Sets that take at least slowSet are reported one by one.
+	struct Tracer
+	{
+		TraceSink* sink = nullptr;
+		std::uint64_t request = 0;
+		const char* grammar = "";	// must outlive the scope
+		std::chrono::nanoseconds slowSet = std::chrono::milliseconds(1);
+	};
+
+	inline thread_local const Tracer* activeTracer = nullptr;
+
+	// The tracer of the innermost TraceScope on this thread, or nullptr.
+	// Without one the parse functions read no clock, each phase costs
+	// this one load.
+	inline const Tracer* currentTracer() { return activeTracer; }
+
+	// Traces every parse function the thread calls while it lives, e.g.
+	// for one request
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const Tracer& tracer) : previous(activeTracer) { activeTracer = &tracer; }
+		~TraceScope() { activeTracer = previous; }
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const Tracer* previous;
+	};
+
+	std::uint64_t traceClock();
+	void recordTrace(const Tracer& tracer, const char* name, std::uint64_t start, std::int64_t set, std::uint64_t items);
+
+	// Reports a phase of the parse from construction to destruction
+	class TraceSpan
+	{
+	public:
+		explicit TraceSpan(const char* name) : tracer(currentTracer()), name(name), start(tracer ? traceClock() : 0) {}
+		~TraceSpan() { if (tracer) recordTrace(*tracer, name, start, -1, items); }
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+		std::uint64_t items = 0;
+
+	private:
+		const Tracer* tracer;
+		const char* name;
+		std::uint64_t start;
+	};
+
+	// For the recognizers: reports set i when it took tracer->slowSet or
+	// more since start
+	inline void traceSet(const Tracer* tracer, std::uint64_t start, std::size_t i, std::size_t items)
+	{
+		if (tracer && traceClock() - start >= (std::uint64_t)tracer->slowSet.count())
+			recordTrace(*tracer, "set", start, i, items);
+	}
+
+	// Chrome trace-event JSON, for chrome://tracing or Perfetto. The
+	// events are written as they come; the array is closed when the sink
+	// is destroyed.
+	class ChromeTraceSink : public TraceSink
+	{
+	public:
+		explicit ChromeTraceSink(std::ostream& out);
+		~ChromeTraceSink();
+		void record(const TraceEvent& event) override;
+
+	private:
+		std::ostream& out;
+		std::mutex lock;
+		bool first = true;
+	};
+
+	// Keeps the last capacity events in a fixed array, for tracing that
+	// stays on: recording takes no lock and allocates nothing. snapshot()
+	// may run while other threads record and skips the slots being
+	// written. A slot is a seqlock whose event is stored as atomic words,
+	// so a reader that races a writer reads stale words, not a data race.
+	class RingBufferSink : public TraceSink
+	{
+	public:
+		explicit RingBufferSink(std::size_t capacity);
+		void record(const TraceEvent& event) override;
+		std::vector<TraceEvent> snapshot() const;	// oldest first
+
+	private:
+		static constexpr std::size_t eventWords = (sizeof(TraceEvent) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+		struct Slot
+		{
+			std::atomic<std::uint64_t> sequence{ 0 };	// odd while written
+			std::atomic<std::uint64_t> event[eventWords] = {};
+		};
+
+		std::unique_ptr<Slot[]> slots;
+		std::size_t capacity;
+		std::atomic<std::uint64_t> next{ 0 };
+	};
+
+	// Writes events, e.g. a snapshot, as a Chrome trace-event JSON file
+	void writeChromeTrace(std::ostream& out, const std::vector<TraceEvent>& events);
+}
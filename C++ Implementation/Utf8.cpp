@@ -0,0 +1,95 @@
+#include "Utf8.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EGP_SSE2_RUNS
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace egp;
+
+namespace
+{
+	bool inRanges(char32_t c, const CharRange* ranges, std::size_t count)
+	{
+		const CharRange* it = std::upper_bound(ranges, ranges + count, c, [](char32_t c, const CharRange& range) {
+			return c < range.first;
+		});
+		return it != ranges && c <= (it - 1)->last;
+	}
+
+#ifdef EGP_SSE2_RUNS
+	const int MAX_SIMD_RANGES = 4;
+
+	int countTrailingZeros(unsigned int bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return index;
+#else
+		return __builtin_ctz(bits);
+#endif
+	}
+#endif
+}
+
+std::size_t egp::matchRun(const char* text, std::size_t length, const CharRange* ranges, std::size_t count)
+{
+	std::size_t pos = 0;
+
+#ifdef EGP_SSE2_RUNS
+	// Bytes are compared as signed chars, so every non-ASCII byte is
+	// negative and falls outside all ranges. The scalar loop below then
+	// decides on the whole code point.
+	__m128i below[MAX_SIMD_RANGES], above[MAX_SIMD_RANGES];
+	int simdRanges = 0;
+	bool simd = true;
+	for (std::size_t r = 0; r < count && ranges[r].first < 128; r++) {
+		if (simdRanges == MAX_SIMD_RANGES) {
+			simd = false;
+			break;
+		}
+		below[simdRanges] = _mm_set1_epi8(char(int(ranges[r].first) - 1));
+		above[simdRanges] = _mm_set1_epi8(char(std::min<char32_t>(ranges[r].last, 127)));
+		++simdRanges;
+	}
+	simd = simd && simdRanges > 0;
+#endif
+
+	while (pos < length) {
+#ifdef EGP_SSE2_RUNS
+		if (simd) {
+			while (pos + 16 <= length) {
+				__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+				__m128i matched = _mm_setzero_si128();
+				for (int r = 0; r < simdRanges; r++) {
+					__m128i inRange = _mm_andnot_si128(_mm_cmpgt_epi8(block, above[r]),
+													   _mm_cmpgt_epi8(block, below[r]));
+					matched = _mm_or_si128(matched, inRange);
+				}
+
+				unsigned int bits = _mm_movemask_epi8(matched);
+				if (bits != 0xFFFF) {
+					pos += countTrailingZeros(~bits);
+					break;
+				}
+				pos += 16;
+			}
+			if (pos >= length)
+				break;
+		}
+#endif
+
+		char32_t c;
+		std::size_t size = decodeUtf8(text + pos, length - pos, c);
+		if (!inRanges(c, ranges, count))
+			break;
+		pos += size;
+	}
+	return pos;
+}
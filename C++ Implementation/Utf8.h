@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+struct CharRange
+{
+	char32_t first, last;
+};
+
+namespace egp
+{
+	// Decodes the code point that starts at text[0] and returns how many
+	// bytes it uses. A malformed sequence decodes as the single byte that
+	// starts it, so byte oriented terminals keep matching non UTF-8 input.
+	inline std::size_t decodeUtf8(const char* text, std::size_t length, char32_t& codePoint)
+	{
+		unsigned char lead = text[0];
+		codePoint = lead;
+		if (lead < 0x80)
+			return 1;
+
+		std::size_t size = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+		if (size == 0 || size > length || lead > 0xF4)
+			return 1;
+
+		char32_t value = lead & (0x7F >> size);
+		for (std::size_t i = 1; i < size; i++) {
+			unsigned char c = text[i];
+			if ((c & 0xC0) != 0x80)
+				return 1;
+			value = (value << 6) | (c & 0x3F);
+		}
+
+		const char32_t minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if (value < minimum[size] || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+			return 1;
+
+		codePoint = value;
+		return size;
+	}
+
+	inline std::string encodeUtf8(char32_t codePoint)
+	{
+		std::string str;
+		if (codePoint < 0x80)
+			str.push_back(char(codePoint));
+		else if (codePoint < 0x800) {
+			str.push_back(char(0xC0 | (codePoint >> 6)));
+			str.push_back(char(0x80 | (codePoint & 0x3F)));
+		}
+		else if (codePoint < 0x10000) {
+			str.push_back(char(0xE0 | (codePoint >> 12)));
+			str.push_back(char(0x80 | ((codePoint >> 6) & 0x3F)));
+			str.push_back(char(0x80 | (codePoint & 0x3F)));
+		}
+		else {
+			str.push_back(char(0xF0 | (codePoint >> 18)));
+			str.push_back(char(0x80 | ((codePoint >> 12) & 0x3F)));
+			str.push_back(char(0x80 | ((codePoint >> 6) & 0x3F)));
+			str.push_back(char(0x80 | (codePoint & 0x3F)));
+		}
+		return str;
+	}
+
+	// Length in bytes of the longest prefix of text whose code points all
+	// fall inside ranges (sorted, non overlapping). Runs of ASCII are
+	// checked 16 bytes at a time with SSE2 when the ranges allow it.
+	std::size_t matchRun(const char* text, std::size_t length, const CharRange* ranges, std::size_t count);
+}